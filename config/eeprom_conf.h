@@ -23,6 +23,13 @@
 #define EEPROM_CONF_H
 
 #define MTD_USE_MUTUAL_EXCLUSION  TRUE
-#define EEPROM_TYPE AT24C02 // available: CAT24C08
+/*
+ * Hardware requirement: the board needs a 2 KiB part (CAT24C16 or compatible) in place of the AT24C02
+ * fitted on the early boards. The stored configuration spans 40 sections of 32 bytes (see nvram::Section),
+ * the AT24C02 holds only the first 8 of them. Every module checks its sections against the configured
+ * part at compile time, so building for a smaller chip fails instead of silently losing the settings.
+ * A replaced chip starts blank, each module then runs on its defaults until configured again.
+ */
+#define EEPROM_TYPE CAT24C16 // available: AT24C02, CAT24C08
 
 #endif // EEPROM_CONF_H
@@ -52,8 +52,8 @@
 #define STM32_USBPRE                        STM32_USBPRE_DIV1P5
 #define STM32_MCOSEL                        STM32_MCOSEL_NOCLOCK
 #define STM32_RTCSEL                        STM32_RTCSEL_HSIDIV
-#define STM32_PVD_ENABLE                    FALSE
-#define STM32_PLS                           STM32_PLS_LEV0
+#define STM32_PVD_ENABLE                    TRUE
+#define STM32_PLS                           STM32_PLS_LEV7
 #define STM32_ADCPRE                        STM32_ADCPRE_DIV6
 
 /*
@@ -85,9 +85,9 @@
  * GPT driver system settings.
  */
 #define STM32_GPT_USE_TIM1                  FALSE
-#define STM32_GPT_USE_TIM2                  TRUE   // Digital input sampling
+#define STM32_GPT_USE_TIM2                  FALSE  // Timer input (V1), driven directly
 #define STM32_GPT_USE_TIM3                  TRUE   // Modbus timeouts handling
-#define STM32_GPT_USE_TIM4                  TRUE   // SDI timings handling
+#define STM32_GPT_USE_TIM4                  FALSE  // Input sampling and output pulses, driven directly
 #define STM32_GPT_USE_TIM5                  FALSE
 #define STM32_GPT_USE_TIM8                  FALSE
 #define STM32_GPT_TIM1_IRQ_PRIORITY         7
@@ -116,7 +116,7 @@
  * ICU driver system settings.
  */
 #define STM32_ICU_USE_TIM1                  FALSE
-#define STM32_ICU_USE_TIM2                  FALSE
+#define STM32_ICU_USE_TIM2                  FALSE  // Timer input (V1), driven directly
 #define STM32_ICU_USE_TIM3                  FALSE
 #define STM32_ICU_USE_TIM4                  FALSE
 #define STM32_ICU_USE_TIM5                  FALSE
@@ -132,7 +132,7 @@
  * PWM driver system settings.
  */
 #define STM32_PWM_USE_ADVANCED              FALSE
-#define STM32_PWM_USE_TIM1                  TRUE
+#define STM32_PWM_USE_TIM1                  (BOARD_VER == 1)  // Analog output (V1), software PWM DMA requests on V2
 #define STM32_PWM_USE_TIM2                  FALSE
 #define STM32_PWM_USE_TIM3                  FALSE
 #define STM32_PWM_USE_TIM4                  FALSE
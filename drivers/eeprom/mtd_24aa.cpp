@@ -131,10 +131,22 @@ namespace nvram {
     return status;
   }
 
-  bool Mtd24aa::wait_op_complete(void)
+  bool Mtd24aa::wait_op_complete(uint32_t offset)
   {
-    if(0 != cfg.programtime) {
+    if(0 == cfg.programtime) {
+      return OSAL_SUCCESS;
+    }
+    if(ack_polling != chThdGetSelfX()) {
       osalThreadSleep(cfg.programtime);
+      return OSAL_SUCCESS;
+    }
+    /* the device doesn't acknowledge its address until the write cycle is over */
+    systime_t start = osalOsGetSystemTimeX();
+    *(uint32_t*)writebuf = offset;
+    while(MSG_OK != i2c_write(nullptr, 0, writebuf, cfg.addr_len)) {
+      if(!osalOsIsTimeWithinX(osalOsGetSystemTimeX(), start, start + cfg.programtime + 1)) {
+        return OSAL_FAILED;
+      }
     }
     return OSAL_SUCCESS;
   }
@@ -152,9 +164,10 @@ namespace nvram {
     *(uint32_t*)writebuf = offset;
     /* write preamble. Only address bytes for this memory type */
     status = i2c_write(txdata, len, writebuf, cfg.addr_len);
-    wait_op_complete();
+    /* a write cycle that didn't finish in time is a failed write */
+    bool result = (MSG_OK == status) ? wait_op_complete(offset) : OSAL_FAILED;
     this->release();
-    if(status == MSG_OK) {
+    if(OSAL_SUCCESS == result) {
       return len;
     }
     else {
@@ -185,12 +198,21 @@ namespace nvram {
    ******************************************************************************
    */
 
+  /* changed under the lock, so a transfer in progress keeps its mode */
+  void Mtd24aa::set_ack_polling(bool enable)
+  {
+    this->acquire();
+    ack_polling = enable ? chThdGetSelfX() : nullptr;
+    this->release();
+  }
+
   Mtd24aa::Mtd24aa(const MtdConfig& cfg, uint8_t* writebuf, size_t writebuf_size,
                    I2CDriver* i2cp, i2caddr_t addr) :
     MtdBase(cfg, writebuf,  writebuf_size),
     i2cp(i2cp),
     addr(addr),
-    i2cflags{}
+    i2cflags{},
+    ack_polling{}
   { }
 
 } //nvram
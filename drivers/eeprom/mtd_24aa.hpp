@@ -33,11 +33,17 @@ namespace nvram {
   public:
     Mtd24aa(const MtdConfig& cfg, uint8_t* writebuf, size_t writebuf_size,
             I2CDriver* i2cp, i2caddr_t addr);
+    /**
+     * @brief   Poll the device for the write cycle completion instead of
+     *          sleeping for the worst case program time. Keeps the CPU busy.
+     * @note    Applies to the writes of the calling thread only.
+     */
+    void set_ack_polling(bool enable);
   protected:
     size_t bus_write(const uint8_t* txdata, size_t len, uint32_t offset);
     size_t bus_read(uint8_t* rxbuf, size_t len, uint32_t offset);
   private:
-    bool wait_op_complete(void);
+    bool wait_op_complete(uint32_t offset);
     msg_t i2c_read(uint8_t* rxbuf, size_t len,
                    uint8_t* writebuf, size_t preamble_len);
     msg_t i2c_write(const uint8_t* txdata, size_t len,
@@ -45,6 +51,7 @@ namespace nvram {
     I2CDriver* i2cp;
     i2caddr_t addr;
     i2cflags_t i2cflags;
+    thread_t* ack_polling;
   };
 
 } //nvram
@@ -259,6 +259,8 @@ namespace Mcudrv {
     template<DataT clearmask, DataT setmask>
     static void ClearAndSet()
     { }
+    static void ClearAndSet(DataT /*clearmask*/, DataT /*setmask*/)
+    { }
     static DataT Read()
     {
       return 0;
@@ -302,6 +304,7 @@ namespace Mcudrv {
         port_id = Port::id
       };
       static const bool Exist = mask;
+      static constexpr bool inverted = false;
       template <GpioBase::Cfg cfg>
       static void SetConfig()
       {
@@ -348,6 +351,7 @@ namespace Mcudrv {
 
   template<typename Pin>
   struct InvertedPin : public Pin {
+    static constexpr bool inverted = true;
     static void Set()
     {
       Pin::Clear();
@@ -24,54 +24,171 @@
 #define PINLIST_H
 
 #include "gpio.h"
+#include <array>
+#include <tuple>
+#include <utility>
 
 namespace Mcudrv {
 
   namespace _impl {
 
-    template<typename...>
-    struct PinlistImplementation;
+    /*
+     * Pins are grouped by port at compile time, so each port is read once from IDR and written once
+     * through BSRR. Port bits are moved to the value bits and back with Utils::Permutation.
+     */
+    template<typename... Pins>
+    struct PinlistImplementation {
+      static constexpr size_t size = sizeof...(Pins);
+      template<size_t i>
+      using Pin = std::tuple_element_t<i, std::tuple<Pins...>>;
 
-    template<typename First, typename... Rest>
-    struct PinlistImplementation<First, Rest...> {
-      template<uint32_t pos = 0>
-      static uint32_t ReadODR()
+      static constexpr uint8_t PortId(size_t i)
       {
-        return ((uint32_t)First::IsSetODR() << pos) | PinlistImplementation<Rest...>::template ReadODR < pos + 1 > ();
+        constexpr uint8_t ids[]{uint8_t(Pins::port_id)...};
+        return ids[i];
       }
-      template<uint32_t pos = 0>
-      static uint32_t Read()
+      static constexpr uint8_t Position(size_t i)
       {
-        return ((uint32_t)First::IsSet() << pos) | PinlistImplementation<Rest...>::template Read < pos + 1 > ();
+        constexpr uint8_t positions[]{uint8_t(Pins::position)...};
+        return positions[i];
       }
-      static void Write(uint32_t value)
+      static constexpr uint32_t InvertMask()
       {
-        First::SetOrClear(value & 0x01);
-        PinlistImplementation<Rest...>::Write(value >> 1);
+        constexpr bool inverted[]{Pins::inverted...};
+        uint32_t mask{};
+        for(size_t i{}; i < size; ++i) {
+          mask |= uint32_t(inverted[i]) << i;
+        }
+        return mask;
       }
-      template<GpioModes conf>
-      static void SetConfig()
+      static constexpr bool IsFirstOfPort(size_t i)
       {
-        First::template SetConfig<conf>();
-        PinlistImplementation<Rest...>::template SetConfig<conf>();
+        for(size_t j{}; j < i; ++j) {
+          if(PortId(j) == PortId(i)) {
+            return false;
+          }
+        }
+        return true;
+      }
+      static constexpr uint32_t PortMask(uint8_t id)
+      {
+        uint32_t mask{};
+        for(size_t i{}; i < size; ++i) {
+          if(PortId(i) == id) {
+            mask |= 1UL << Position(i);
+          }
+        }
+        return mask;
+      }
+      //Port bit -> value bit
+      template<uint8_t id>
+      struct GatherMap {
+        static constexpr std::array<int8_t, 16> Get()
+        {
+          std::array<int8_t, 16> dest{};
+          for(auto& d : dest) {
+            d = -1;
+          }
+          for(size_t i{}; i < size; ++i) {
+            if(PortId(i) == id) {
+              dest[Position(i)] = int8_t(i);
+            }
+          }
+          return dest;
+        }
+      };
+      //Value bit -> port bit
+      template<uint8_t id>
+      struct ScatterMap {
+        static constexpr std::array<int8_t, size> Get()
+        {
+          std::array<int8_t, size> dest{};
+          for(size_t i{}; i < size; ++i) {
+            dest[i] = PortId(i) == id ? int8_t(Position(i)) : -1;
+          }
+          return dest;
+        }
+      };
+
+      template<size_t i, bool odr>
+      static uint32_t ReadPort()
+      {
+        if constexpr(IsFirstOfPort(i)) {
+          using Port = typename Pin<i>::Port;
+          using Gather = Utils::Permutation<GatherMap<PortId(i)>>;
+          return Gather::Apply(odr ? Port::ReadODR() : Port::Read());
+        }
+        else {
+          return 0;
+        }
+      }
+      template<size_t i>
+      static void WritePort(uint32_t value)
+      {
+        if constexpr(IsFirstOfPort(i)) {
+          using Port = typename Pin<i>::Port;
+          using Scatter = Utils::Permutation<ScatterMap<PortId(i)>>;
+          constexpr uint32_t portMask = PortMask(PortId(i));
+          uint32_t set = Scatter::Apply(value);
+          Port::ClearAndSet(uint16_t(portMask & ~set), uint16_t(set));
+        }
+      }
+      template<size_t i>
+      static void WritePort(uint32_t value, uint32_t mask)
+      {
+        if constexpr(IsFirstOfPort(i)) {
+          using Port = typename Pin<i>::Port;
+          using Scatter = Utils::Permutation<ScatterMap<PortId(i)>>;
+          uint32_t portMask = Scatter::Apply(mask);
+          if(portMask) {
+            uint32_t set = Scatter::Apply(value & mask);
+            Port::ClearAndSet(uint16_t(portMask & ~set), uint16_t(set));
+          }
+        }
+      }
+
+      template<size_t... i>
+      static uint32_t Read(std::index_sequence<i...>)
+      {
+        return (0 | ... | ReadPort<i, false>());
+      }
+      template<size_t... i>
+      static uint32_t ReadODR(std::index_sequence<i...>)
+      {
+        return (0 | ... | ReadPort<i, true>());
+      }
+      template<size_t... i>
+      static void Write(uint32_t value, std::index_sequence<i...>)
+      {
+        (WritePort<i>(value), ...);
+      }
+      template<size_t... i>
+      static void Write(uint32_t value, uint32_t mask, std::index_sequence<i...>)
+      {
+        (WritePort<i>(value, mask), ...);
       }
-    };
 
-    template<>
-    struct PinlistImplementation<> {
-      template<uint32_t pos>
       static uint32_t ReadODR()
       {
-        return 0;
+        return ReadODR(std::make_index_sequence<size>{}) ^ InvertMask();
       }
-      template<uint32_t pos>
       static uint32_t Read()
       {
-        return 0;
+        return Read(std::make_index_sequence<size>{}) ^ InvertMask();
+      }
+      static void Write(uint32_t value)
+      {
+        Write(value ^ InvertMask(), std::make_index_sequence<size>{});
+      }
+      static void Write(uint32_t value, uint32_t mask)
+      {
+        Write(value ^ InvertMask(), mask, std::make_index_sequence<size>{});
       }
-      static void Write(uint32_t) {}
       template<GpioModes conf>
-      static void SetConfig() {}
+      static void SetConfig()
+      {
+        (Pins::template SetConfig<conf>(), ...);
+      }
     };
 
     using Utils::NumberToMask;
@@ -85,18 +202,37 @@ namespace Mcudrv {
 
   template<typename First, typename... Rest>
   struct Pinlist {
+    using Implementation = _impl::PinlistImplementation<First, Rest...>;
+    static constexpr size_t size = Implementation::size;
+    static constexpr uint8_t PortId(size_t i)
+    {
+      return Implementation::PortId(i);
+    }
+    static constexpr uint8_t Position(size_t i)
+    {
+      return Implementation::Position(i);
+    }
+    static constexpr bool IsInverted(size_t i)
+    {
+      return Implementation::InvertMask() & (1UL << i);
+    }
     static uint32_t ReadODR()
     {
-      return _impl::PinlistImplementation<First, Rest...>::template ReadODR<>();
+      return _impl::PinlistImplementation<First, Rest...>::ReadODR();
     }
     static uint32_t Read()
     {
-      return _impl::PinlistImplementation<First, Rest...>::template Read<>();
+      return _impl::PinlistImplementation<First, Rest...>::Read();
     }
     static void Write(uint32_t value)
     {
       _impl::PinlistImplementation<First, Rest...>::Write(value);
     }
+    //Only the pins selected by the mask are changed
+    static void Write(uint32_t value, uint32_t mask)
+    {
+      _impl::PinlistImplementation<First, Rest...>::Write(value, mask);
+    }
     template<GpioModes conf>
     static void SetConfig()
     {
@@ -123,6 +259,11 @@ namespace Mcudrv {
     {
       Port::ClearAndSet((~value & mask) << offset, (value & mask) << offset);
     }
+    static void Write(uint16_t value, uint16_t valueMask)
+    {
+      valueMask &= mask;
+      Port::ClearAndSet((~value & valueMask) << offset, (value & valueMask) << offset);
+    }
     template<GpioModes conf>
     static void SetConfig()
     {
@@ -33,15 +33,32 @@
 #include "digitalout.h"
 #include "modbus_impl.h"
 #include "at24_impl.h"
+#include "eventlog.h"
+#include "ratemeter.h"
+#include "counterstore.h"
+#include "pulsetimer.h"
+#include "schedule.h"
+#include "logic.h"
 
 #if BOARD_VER == 1
 #include "analogout.h"
+#include "pid.h"
+// Just the stub
+namespace Digital {
+  static struct SoftPwm {
+    void Init() {}
+  } softPwm;
+}
 #else
+#include "softpwm.h"
 // Just the stub
 namespace Analog {
   static struct Output {
     void Init() {}
   } output;
+  static struct PidControl {
+    void Init() {}
+  } pidControl;
 }
 #endif
 
@@ -49,9 +66,17 @@ using namespace Rtos;
 using namespace Mcudrv;
 
 static constexpr auto& dout = Digital::output;
+static constexpr auto& ptimer = Digital::pulseTimer;
+static constexpr auto& spwm = Digital::softPwm;
+static constexpr auto& sched = Digital::schedule;
+static constexpr auto& logic = Digital::logicEngine;
 static constexpr auto& aout = Analog::output;
 static constexpr auto& ain = Analog::input;
+static constexpr auto& pid = Analog::pidControl;
 static constexpr auto& din = Digital::input;
+static constexpr auto& evlog = Digital::eventLog;
+static constexpr auto& rates = Digital::rateMeter;
+static constexpr auto& cstore = Digital::counterStore;
 
 static auto Init = [](auto&&... objs) {
   (objs.Init(), ...);
@@ -65,7 +90,7 @@ using nvram::eeprom;
 int main(void) {
   halInit();
   System::init();
-  Init(eeprom, aout, dout, ain, din, modbus);
+  Init(eeprom, evlog, aout, dout, ptimer, sched, spwm, ain, din, rates, cstore, logic, pid, modbus);
   Shell sh;
   systime_t time = chVTGetSystemTimeX();
   while(true) {
@@ -21,6 +21,8 @@
  */
 
 #include "analogout.h"
+#include "at24_impl.h"
+#include "cyclecounter.h"
 
 
 namespace Analog {
@@ -28,9 +30,9 @@ namespace Analog {
   Output output;
 
   const PWMConfig Output::pwmcfg_ {
-    8000000UL,                                    /* 8MHz PWM clock frequency.   */
+    pwmClock,                                     /* 8MHz PWM clock frequency.   */
     Resolution,                                   /* Initial PWM period 1ms.      */
-    nullptr,
+    PeriodCallback,
     {
       {PWM_OUTPUT_ACTIVE_HIGH, nullptr},
       {PWM_OUTPUT_ACTIVE_HIGH, nullptr},
@@ -52,31 +54,300 @@ namespace Analog {
       thread_t *tp = chMsgWait();
       OutputCommand& cmd = *reinterpret_cast<OutputCommand*>(chMsgGet(tp));
       auto chMask = cmd.GetChannelMask();
+      targets_t targets;
       for(pwmchannel_t i{}; i < cmd.GetChannelNumber(); ++i) {
         if(chMask & (1U << i)) {
-          SetValue(i, cmd.GetValue(i));
+          targets[i] = uint32_t(cmd.GetValue(i)) << 8;
         }
         else {
           cmd.SetValue(i, values_[i]);
         }
       }
+      if(chMask) {
+        Stage(chMask, targets, cmd.IsImmediate());
+      }
       chMsgRelease(tp, MSG_OK);
     }
   }
 
-  void Output::SetValue(pwmchannel_t ch, pwmcnt_t value)
+  void Output::SetFineValues(uint16_t mask, const targets_t& values)
+  {
+    targets_t targets;
+    for(size_t ch{}; ch < targets.size(); ++ch) {
+      targets[ch] = values[ch] << (8 - fineBits);
+    }
+    Stage(mask, targets);
+  }
+
+  void Output::Stage(uint16_t mask, const targets_t& targets, bool immediate)
+  {
+    Rtos::SysLockGuard lock;
+    if(!hold_ || immediate) {
+      SetTargetsI(mask, targets);
+      return;
+    }
+    for(size_t ch{}; ch < staged_.size(); ++ch) {
+      if(mask & (1U << ch)) {
+        staged_[ch] = targets[ch];
+      }
+    }
+    stagedMask_ |= mask;
+  }
+
+  void Output::SetHold(bool hold)
+  {
+    Rtos::SysLockGuard lock;
+    hold_ = hold;
+    if(!hold) {
+      CommitI();
+    }
+  }
+
+  void Output::Commit()
   {
-    pwmEnableChannel(PWMD_, ch, value);
-    values_[ch] = static_cast<channel_array_t::value_type>(value);
+    Rtos::SysLockGuard lock;
+    CommitI();
+  }
+
+  void Output::CommitI()
+  {
+    SetTargetsI(stagedMask_, staged_);
+    stagedMask_ = 0;
+  }
+
+  /*
+   * The update event is disabled while the compare preload registers are written, so all the channels
+   * change in the same PWM period, even if the counter wraps in the middle of the writes.
+   */
+  void Output::SetTargetsI(uint16_t mask, const targets_t& targets)
+  {
+    PWMD_->tim->CR1 |= TIM_CR1_UDIS;
+    for(pwmchannel_t ch{}; ch < targets.size(); ++ch) {
+      if(mask & (1U << ch)) {
+        SetTargetI(ch, targets[ch]);
+      }
+    }
+    PWMD_->tim->CR1 &= ~TIM_CR1_UDIS;
+  }
+
+  void Output::SetTargetI(pwmchannel_t ch, uint32_t target)
+  {
+    targets_[ch] = target;
+    values_[ch] = static_cast<channel_array_t::value_type>(target >> 8);
+    if(wavePlaying_ && ch == wave_.channel) {
+      return;
+    }
+    if(!ramps_[ch]) {
+      present_[ch] = target;
+      rampMask_ &= ~(1U << ch);
+      WriteI(ch);
+    }
+    else if(present_[ch] != target) {
+      rampMask_ |= 1U << ch;
+    }
+    if(rampMask_ || DitheringMaskI()) {
+      pwmEnablePeriodicNotificationI(PWMD_);
+    }
+  }
+
+  void Output::WriteI(pwmchannel_t ch)
+  {
+    uint32_t value = ditherMask_ & (1U << ch) ? Dither(present_[ch], ditherAcc_[ch]) : present_[ch] >> 8;
+    pwmEnableChannelI(PWMD_, ch, value);
+  }
+
+  void Output::PeriodCallback(PWMDriver*)
+  {
+    uint32_t start = Utils::CycleCounter::Get();
+    Rtos::SysLockGuardFromISR lock;
+    output.PeriodI();
+    uint32_t cycles = Utils::CycleCounter::Get() - start;
+    if(cycles > output.maxPeriodCycles_) {
+      output.maxPeriodCycles_ = cycles;
+    }
+  }
+
+  void Output::PeriodI()
+  {
+    PlayI();
+    RampI();
+    DitherI();
+    if(!rampMask_ && !wavePlaying_ && !DitheringMaskI()) {
+      pwmDisablePeriodicNotificationI(PWMD_);
+    }
+  }
+
+  void Output::RampI()
+  {
+    for(pwmchannel_t ch{}; ch < present_.size(); ++ch) {
+      if(!(rampMask_ & (1U << ch))) {
+        continue;
+      }
+      uint32_t target = targets_[ch];
+      auto& present = present_[ch];
+      //A rate cleared in the middle of a ramp completes it at once
+      uint32_t step = ramps_[ch] ? ramps_[ch] : UINT32_MAX;
+      if(present < target) {
+        present = target - present > step ? present + step : target;
+      }
+      else {
+        present = present - target > step ? present - step : target;
+      }
+      WriteI(ch);
+      if(present == target) {
+        rampMask_ &= ~(1U << ch);
+      }
+    }
+  }
+
+  //Ramping channels are already written
+  void Output::DitherI()
+  {
+    uint16_t mask = DitheringMaskI() & ~rampMask_;
+    for(pwmchannel_t ch{}; mask; ++ch, mask >>= 1) {
+      if(mask & 0x01) {
+        WriteI(ch);
+      }
+    }
+  }
+
+  //Dithered channels with a fraction to spread
+  uint16_t Output::DitheringMaskI() const
+  {
+    uint16_t mask{};
+    for(size_t ch{}; ch < present_.size(); ++ch) {
+      if(present_[ch] & 0xFF) {
+        mask |= uint16_t(1U << ch);
+      }
+    }
+    return mask & ditherMask_;
+  }
+
+  //The last sample of a cycle is held for its full divider before the cycle count is checked
+  void Output::PlayI()
+  {
+    if(!wavePlaying_ || ++waveTick_ < wave_.divider) {
+      return;
+    }
+    waveTick_ = 0;
+    if(waveIndex_ == wave_.length) {
+      waveIndex_ = 0;
+      if(wave_.repeat && ++waveCycles_ == wave_.repeat) {
+        StopWaveI();
+        return;
+      }
+    }
+    auto ch = static_cast<pwmchannel_t>(wave_.channel);
+    present_[ch] = uint32_t(waveTable_[waveIndex_++]) << 8;
+    WriteI(ch);
+  }
+
+  void Output::StopWaveI()
+  {
+    if(!wavePlaying_) {
+      return;
+    }
+    wavePlaying_ = false;
+    auto ch = static_cast<pwmchannel_t>(wave_.channel);
+    SetTargetI(ch, targets_[ch]);
   }
 
   void Output::Init()
   {
+    static_assert(nvram::Eeprom::Fits(nvram::Section::AnalogRamps, 0, sizeof(ramps_t)),
+                  "Ramp rates don't fit the configured EEPROM");
+    ramps_t ramps;
+    if(sizeof(ramps) == nvram::eeprom.Read(nvram::Section::AnalogRamps, ramps) && IsValid(ramps)) {
+      ramps_ = ramps;
+    }
+    static_assert(nvram::Eeprom::Fits(nvram::Section::AnalogRamps, sizeof(ramps_t), sizeof(ditherMask_)),
+                  "Dither mask doesn't fit the configured EEPROM");
+    uint16_t ditherMask;
+    if(sizeof(ditherMask) == nvram::eeprom.Read(nvram::Section::AnalogRamps, ditherMask, sizeof(ditherMask), sizeof(ramps_t))
+       && ditherMask <= maxChannelMask) {
+      ditherMask_ = ditherMask;
+    }
     palSetBusMode(const_cast<IOBus*>(&pwmBus_), PAL_MODE_STM32_ALTERNATE_PUSHPULL);
     pwmStart(PWMD_, &pwmcfg_);
     start(NORMALPRIO);
   }
 
+  Rtos::Status Output::SetWavePoint(size_t index, uint16_t value)
+  {
+    if(index >= maxWavePoints || value > Resolution) {
+      return Rtos::Status::Failure;
+    }
+    waveTable_[index] = value;
+    return Rtos::Status::Success;
+  }
+
+  Rtos::Status Output::SetWaveSettings(const WaveSettings& settings)
+  {
+    if(settings.channel >= OutputCommand::GetChannelNumber() || !settings.length
+       || settings.length > maxWavePoints || !settings.divider) {
+      return Rtos::Status::Failure;
+    }
+    Rtos::SysLockGuard lock;
+    waveSettings_ = settings;
+    return Rtos::Status::Success;
+  }
+
+  void Output::StartWave()
+  {
+    Rtos::SysLockGuard lock;
+    StopWaveI();
+    wave_ = waveSettings_;
+    waveIndex_ = 0;
+    waveTick_ = wave_.divider - 1;
+    waveCycles_ = 0;
+    rampMask_ &= ~(1U << wave_.channel);
+    wavePlaying_ = true;
+    pwmEnablePeriodicNotificationI(PWMD_);
+  }
+
+  void Output::StopWave()
+  {
+    Rtos::SysLockGuard lock;
+    StopWaveI();
+  }
+
+  Rtos::Status Output::SetDitherMask(uint16_t mask)
+  {
+    if(mask > maxChannelMask) {
+      return Rtos::Status::Failure;
+    }
+    {
+      Rtos::SysLockGuard lock;
+      ditherMask_ = mask;
+      ditherAcc_.fill(0);
+      for(pwmchannel_t ch{}; ch < present_.size(); ++ch) {
+        WriteI(ch);
+      }
+      if(DitheringMaskI()) {
+        pwmEnablePeriodicNotificationI(PWMD_);
+      }
+    }
+    if(sizeof(mask) != nvram::eeprom.Write(nvram::Section::AnalogRamps, mask, sizeof(ramps_t))) {
+      return Rtos::Status::Failure;
+    }
+    return Rtos::Status::Success;
+  }
+
+  Rtos::Status Output::SetRamps(const ramps_t& ramps)
+  {
+    if(!IsValid(ramps)) {
+      return Rtos::Status::Failure;
+    }
+    {
+      Rtos::SysLockGuard lock;
+      ramps_ = ramps;
+    }
+    if(sizeof(ramps) != nvram::eeprom.Write(nvram::Section::AnalogRamps, ramps)) {
+      return Rtos::Status::Failure;
+    }
+    return Rtos::Status::Success;
+  }
+
   msg_t Output::SendMessage(OutputCommand& msg)
   {
     return chMsgSend(thread_ref, reinterpret_cast<msg_t>(&msg));
@@ -23,6 +23,7 @@
 #define ANALOGOUT_H
 
 #include <array>
+#include <algorithm>
 #include "ch_extended.h"
 #include "hal.h"
 #include "type_traits_ex.h"
@@ -39,6 +40,7 @@ namespace Analog {
     static constexpr size_t maxMask_ = Utils::NumberToMask_v<chNumber_>;
     channel_array_t values_;
     uint16_t channelMask_;
+    bool immediate_;
   public:
     static constexpr size_t GetChannelNumber()
     {
@@ -65,23 +67,155 @@ namespace Analog {
     {
       channelMask_ = 0;
     }
+    bool IsImmediate() const
+    {
+      return immediate_;
+    }
+    //Immediate command isn't staged in the hold mode, for the internal writers such as the PID loops
+    void SetImmediate(bool immediate = true)
+    {
+      immediate_ = immediate;
+    }
   };
 
+  /*
+   * A channel with a nonzero ramp rate slews to a new value in the timer update interrupt, the compare
+   * value is preloaded so each step takes effect exactly at the next PWM period. A waveform table is
+   * played the same way on one channel, a sample every divider periods. A dithered channel spreads the
+   * fraction of its 16-bit fine value over the periods with a first order sigma-delta, adding 4 bits
+   * of resolution at the cost of a ripple of one count. The interrupt is only enabled while some channel
+   * is ramping, dithering a fraction or playing a waveform.
+   * The channels of one command are committed to the preload registers together. In the hold mode the
+   * writes are only staged until a commit, which may come as a Modbus broadcast to several modules,
+   * the immediate commands are applied anyway.
+   */
   class Output : Rtos::BaseStaticThread<256>
   {
+  public:
+    static constexpr size_t Resolution = 4096;
+    static constexpr uint32_t pwmClock = 8000000UL;
+    static constexpr uint32_t periodUs = Resolution * 1000000UL / pwmClock;
+    //1/256 of a count per PWM period, 0 - the value is set immediately
+    using ramps_t = channel_array_t;
+    static constexpr uint16_t maxRamp = 0x7FFF;
+    static constexpr size_t fineBits = 4;
+    static constexpr uint16_t maxChannelMask = Utils::NumberToMask_v<4>;
+    using targets_t = std::array<uint32_t, 4>;
+    static constexpr size_t maxWavePoints = 256;
+    struct WaveSettings {
+      uint16_t channel;
+      uint16_t length;
+      uint16_t divider;     //PWM periods per sample
+      uint16_t repeat;      //0 - continuous
+    };
   private:
     static const PWMConfig pwmcfg_;
     PWMDriver* const PWMD_;
-    channel_array_t values_;
+    channel_array_t values_;              //targets
+    targets_t targets_;                   //Q8
+    targets_t present_;                   //Q8, ramped by the interrupt
+    targets_t ditherAcc_;                 //Q8 fraction carried to the next period
+    targets_t staged_;                    //Q8, waiting for a commit
+    uint16_t stagedMask_;
+    bool hold_;
+    ramps_t ramps_;
+    uint16_t rampMask_;
+    uint16_t ditherMask_;
+    uint32_t maxPeriodCycles_;
+    std::array<uint16_t, maxWavePoints> waveTable_;
+    WaveSettings waveSettings_, wave_;    //written, playing
+    uint16_t waveIndex_, waveTick_, waveCycles_;
+    bool wavePlaying_;
     const IOBus pwmBus_{GPIOA, 0x0F, 8};
     void main() override;
-    void SetValue(pwmchannel_t ch, pwmcnt_t value);
+    void Stage(uint16_t mask, const targets_t& targets, bool immediate = false);
+    void CommitI();
+    void SetTargetsI(uint16_t mask, const targets_t& targets);
+    void SetTargetI(pwmchannel_t ch, uint32_t target);
+    void WriteI(pwmchannel_t ch);
+    static void PeriodCallback(PWMDriver*);
+    void PeriodI();
+    void RampI();
+    void PlayI();
+    void DitherI();
+    uint16_t DitheringMaskI() const;
+    void StopWaveI();
+    static bool IsValid(const ramps_t& ramps)
+    {
+      return std::all_of(ramps.cbegin(), ramps.cend(), [](uint16_t ramp) { return ramp <= maxRamp; });
+    }
   public:
-    static constexpr size_t Resolution = 4096;
-    Output() : PWMD_{&PWMD1}, values_{}
+    Output() : PWMD_{&PWMD1}, values_{}, targets_{}, present_{}, ditherAcc_{}, staged_{}, stagedMask_{},
+      hold_{}, ramps_{}, rampMask_{},
+      ditherMask_{}, maxPeriodCycles_{}, waveTable_{},
+      waveSettings_{0, 1, 1, 0}, wave_{}, waveIndex_{}, waveTick_{}, waveCycles_{}, wavePlaying_{}
     { }
     void Init();
     msg_t SendMessage(OutputCommand& msg);
+    Rtos::Status SetRamps(const ramps_t& ramps);
+    ramps_t GetRamps()
+    {
+      Rtos::SysLockGuard lock;
+      return ramps_;
+    }
+    //Values in 1/16 counts, the fraction is dropped on a channel not dithered. The channels of the mask change together
+    void SetFineValues(uint16_t mask, const targets_t& values);
+    uint16_t GetFineValue(size_t ch)
+    {
+      Rtos::SysLockGuard lock;
+      return uint16_t(targets_[ch] >> (8 - fineBits));
+    }
+    //Releasing the hold commits the staged values
+    void SetHold(bool hold);
+    bool GetHold()
+    {
+      return hold_;
+    }
+    void Commit();
+    uint16_t GetStagedMask()
+    {
+      return stagedMask_;
+    }
+    Rtos::Status SetDitherMask(uint16_t mask);
+    uint16_t GetDitherMask()
+    {
+      return ditherMask_;
+    }
+    //First order sigma-delta step: the integer output for the period, the fraction accumulates in acc
+    static uint32_t Dither(uint32_t value, uint32_t& acc)
+    {
+      uint32_t sum = acc + (value & 0xFF);
+      acc = sum & 0xFF;
+      return (value >> 8) + (sum >> 8);
+    }
+    //Longest update interrupt in core cycles
+    uint32_t GetMaxPeriodCycles() const
+    {
+      return maxPeriodCycles_;
+    }
+    void ResetMaxPeriodCycles()
+    {
+      maxPeriodCycles_ = 0;
+    }
+    Rtos::Status SetWavePoint(size_t index, uint16_t value);
+    uint16_t GetWavePoint(size_t index)
+    {
+      return waveTable_[index];
+    }
+    //Takes effect on the next start
+    Rtos::Status SetWaveSettings(const WaveSettings& settings);
+    WaveSettings GetWaveSettings()
+    {
+      Rtos::SysLockGuard lock;
+      return waveSettings_;
+    }
+    //The channel returns to its set value when the playback stops, ramped if it has a rate
+    void StartWave();
+    void StopWave();
+    bool IsWavePlaying()
+    {
+      return wavePlaying_;
+    }
     ~Output() override;
   };
 
@@ -21,16 +21,152 @@
  */
 
 #include "digitalin.h"
+#include "at24_impl.h"
+#include <algorithm>
 
 namespace Digital {
 
-  void Input::gptCb(GPTDriver* gpt)
+  static constexpr uint32_t cyclesPerUs = STM32_SYSCLK / 1000000UL;
+
+  void Input::SampleI()
+  {
+    auto self = &input;
+    if(self->fifo_.push(Pins::Read() | ExpansionInputs::ReadI() << numNativeChannels)) {
+      uint32_t depth = self->fifo_.wasSize();
+      if(depth > self->fifoMaxDepth_.load(std::memory_order_relaxed)) {
+        self->fifoMaxDepth_.store(depth, std::memory_order_relaxed);
+      }
+    }
+    else {
+      self->fifoOverruns_.fetch_add(1, std::memory_order_relaxed);
+    }
+    timerInput.SampleI();
+    self->stayPoint_.ResumeFromISR();
+  }
+
+  void Input::extCb(EXTDriver* /*ext*/, expchannel_t line)
+  {
+    for(size_t i{}; i < numNativeChannels; ++i) {
+      if(extLines_[i] == line) {
+        input.OnEdge(i);
+        break;
+      }
+    }
+  }
+
+  //Without filtering only rising edges are enabled, otherwise the pulse is counted on its falling edge.
+  //The edge the pulse is counted on is logged.
+  void Input::OnEdge(size_t ch)
+  {
+    using PinRead = bool(*)();
+    static constexpr std::array<PinRead, numNativeChannels> isSet{Pc15::IsSet, Pc14::IsSet,
+                                                                  Pc13::IsSet, Pb2::IsSet};
+    auto& extCh = extChannels_[ch];
+    if(!extCh.minWidth) {
+      counters_[ch].fetch_add(1, std::memory_order_relaxed);
+      eventLog.PushFromISR(NativeEventChannel(ch), true);
+      return;
+    }
+    uint32_t now = Utils::CycleCounter::Get();
+    if(isSet[ch]()) {
+      extCh.riseTime = now;
+    }
+    else if(now - extCh.riseTime >= extCh.minWidth) {
+      counters_[ch].fetch_add(1, std::memory_order_relaxed);
+      eventLog.PushFromISR(NativeEventChannel(ch), false);
+    }
+  }
+
+  bool Input::IsValid(const InputConfig& config)
+  {
+    constexpr uint32_t channelsMask = Utils::NumberToMask_v<numNativeChannels>;
+    return !(config.interruptMask & ~channelsMask) && !(config.hwCounterMask & ~channelsMask)
+           && (!config.hwCounterMask || Utils::IsPowerOf2(config.hwCounterMask))
+           && !(config.interruptMask & config.hwCounterMask)
+           && config.timerInputMode <= uint16_t(TimerInput::Mode::Encoder)
+           && (config.timerInputMode == uint16_t(TimerInput::Mode::Counter) || !config.hwCounterMask)
+           && config.captureAveraging <= TimerInput::maxAveraging
+           && std::all_of(config.debounce.begin(), config.debounce.end(),
+                          [](uint16_t depth) { return depth <= Debouncer<>::maxDepth; })
+           && config.expansionDebounce <= Debouncer<>::maxDepth
+           && (!numExpansionChannels || config.timerInputMode != uint16_t(TimerInput::Mode::Encoder));
+  }
+
+  void Input::ApplyConfig(const InputConfig& config)
+  {
+    uint32_t interruptMask{};
+    for(size_t i{}; i < numNativeChannels; ++i) {
+      expchannel_t line = extLines_[i];
+      //extSetChannelMode() keeps the mode in extcfg_, disabling a line without edges asserts
+      if(extcfg_.channels[line].mode & EXT_CH_MODE_EDGES_MASK) {
+        extChannelDisable(&EXTD1, line);
+      }
+      if(config.interruptMask & (1U << i)) {
+        {
+          Rtos::SysLockGuard lock;
+          extChannels_[i].minWidth = config.minPulseWidth[i] * cyclesPerUs;
+          extChannels_[i].riseTime = Utils::CycleCounter::Get();
+        }
+        EXTChannelConfig chcfg{(config.minPulseWidth[i] ? EXT_CH_MODE_BOTH_EDGES : EXT_CH_MODE_RISING_EDGE)
+                               | extPorts_[i], extCb};
+        extSetChannelMode(&EXTD1, line, &chcfg);
+        interruptMask |= 1U << i;
+      }
+    }
+    if(config.timerInputMode != config_.timerInputMode || config.captureAveraging != config_.captureAveraging) {
+      timerInput.SetMode(TimerInput::Mode(config.timerInputMode), config.captureAveraging);
+    }
+    std::array<uint16_t, numNativeChannels + numExpansionChannels> depth;
+    std::copy(config.debounce.begin(), config.debounce.end(), depth.begin());
+    std::fill(depth.begin() + numNativeChannels, depth.end(), config.expansionDebounce);
+    debouncer_.SetDepth(depth);
+    externalMask_ = interruptMask | config.hwCounterMask;
+    hwCounterMask_ = config.hwCounterMask;
+    config_ = config;
+  }
+
+  void Input::Init()
+  {
+    Pins::SetConfig<GpioModes::InputFloating>();
+    Pa12::SetConfig<GpioModes::OutputPushPull>();
+    Utils::CycleCounter::Enable();
+    extStart(&EXTD1, &extcfg_);
+    timerInput.Init();
+    ExpansionInputs::Init();
+    static_assert(nvram::Eeprom::Fits(nvram::Section::DigitalInput, 0, sizeof(InputConfig)),
+                  "Input configuration doesn't fit the configured EEPROM");
+    InputConfig config;
+    if(sizeof(config) != nvram::eeprom.Read(nvram::Section::DigitalInput, config) || !IsValid(config)) {
+      config = {};
+    }
+    ApplyConfig(config);
+    start(NORMALPRIO + 9);
+    static_assert(PulseTimer::tickRate == TimerInput::encoderSampleRate, "Sampling rate mismatch");
+    pulseTimer.SetTickCallback(SampleI);
+  }
+
+  Rtos::Status Input::SetConfig(const InputConfig& config)
+  {
+    if(!IsValid(config)) {
+      return Rtos::Status::Failure;
+    }
+    {
+      Rtos::SemLockGuard lock{semConfig_};
+      ApplyConfig(config);
+    }
+    if(sizeof(config) != nvram::eeprom.Write(nvram::Section::DigitalInput, config)) {
+      return Rtos::Status::Failure;
+    }
+    return Rtos::Status::Success;
+  }
+
+  InputConfig Input::GetConfig()
   {
-    auto self = static_cast<Input*>(gpt->customData);
-    self->fifo_.push(Pins::Read());
+    Rtos::SemLockGuard lock{semConfig_};
+    return config_;
   }
 
-  const GPTConfig Input::gptconf_{100000, Input::gptCb, 0, 0};
+  EXTConfig Input::extcfg_{};
 
   Input input;
 
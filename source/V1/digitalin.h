@@ -23,58 +23,127 @@
 #define DIGITALIN_H
 
 #include "analogin.h"
+#include "cyclecounter.h"
+#include "debounce.h"
+#include "eventlog.h"
+#include "inputchain.h"
+#include "pulsetimer.h"
+#include "timerinput.h"
+#include <atomic>
 
 namespace Digital {
 using namespace Mcudrv;
 
+  static constexpr size_t NATIVE_CH_NUMBER = 4;
+
+  struct InputConfig {
+    //Channels counted in EXTI interrupt instead of the polling
+    uint16_t interruptMask;
+    //Minimal pulse width in us for interrupt driven channels, 0 - no filtering
+    std::array<uint16_t, NATIVE_CH_NUMBER> minPulseWidth;
+    //Single channel which counter is taken from the hardware counter, the pulses have to be wired to its input
+    uint16_t hwCounterMask;
+    uint16_t timerInputMode;  //TimerInput::Mode
+    //Number of periods averaged in the capture mode
+    uint16_t captureAveraging;
+    //Number of 2ms samples a new level of the polled channel must be stable for, 0 - no filtering
+    std::array<uint16_t, NATIVE_CH_NUMBER> debounce;
+    //The same for all the expansion chain inputs
+    uint16_t expansionDebounce;
+  };
+  static_assert(sizeof(InputConfig) <= nvram::Eeprom::SectionSize, "Digital input section overflow");
+
   class Input : Rtos::BaseStaticThread<128>
   {
   public:
-    static constexpr size_t numChannels = 4 + Analog::Input::numChannels;
+    static constexpr size_t numChannels = NATIVE_CH_NUMBER + Analog::Input::numChannels;
+    static constexpr size_t numNativeChannels = NATIVE_CH_NUMBER;
+    //Sampled, debounced and counted along with the native inputs, above them in the sample word
+    static constexpr size_t numExpansionChannels = ExpansionInputs::numChannels;
+    using counters_buf_t = std::array<uint32_t, numChannels>;
+    using expansion_counters_buf_t = std::array<uint32_t, numExpansionChannels>;
+    struct FifoStat {
+      uint32_t overruns;  //samples dropped on the full fifo
+      uint32_t maxDepth;
+    };
   private:
     using Pins = Pinlist<Pc15, Pc14, Pc13, Pb2>;
-    using counters_buf_t = std::array<uint32_t, numChannels>;
-    using internal_counters_buf_t = std::array<uint32_t, 4>;
-    GPTDriver& GPTD_;
-    static const GPTConfig gptconf_;
-    Rtos::BinarySemaphore semVal_, semCounters_;
+    static constexpr uint32_t nativeMask = Utils::NumberToMask_v<numNativeChannels>;
+    using internal_counters_buf_t = std::array<std::atomic_uint32_t, numNativeChannels + numExpansionChannels>;
+    static constexpr std::array<expchannel_t, numNativeChannels> extLines_{15, 14, 13, 2};
+    static constexpr std::array<uint32_t, numNativeChannels> extPorts_{EXT_MODE_GPIOC, EXT_MODE_GPIOC,
+                                                                       EXT_MODE_GPIOC, EXT_MODE_GPIOB};
+    struct ExtChannel {
+      uint32_t minWidth;  //core clock cycles
+      uint32_t riseTime;
+    };
+    //Modified by the driver on channel mode change
+    static EXTConfig extcfg_;
+    Rtos::BinarySemaphore semVal_, semCounters_, semConfig_;
     memory_relaxed_acquire_release::CircularFifo<uint32_t, 8> fifo_;
+    Rtos::ThreadStayPoint stayPoint_;
+    Debouncer<> debouncer_;
+    //Updated by the sampling ISR only
+    std::atomic_uint32_t fifoOverruns_, fifoMaxDepth_;
     internal_counters_buf_t counters_;
+    std::array<ExtChannel, numNativeChannels> extChannels_;
+    //Channels not counted by the polling
+    std::atomic_uint32_t externalMask_, hwCounterMask_;
+    InputConfig config_;
     uint16_t binaryVal_;
-    static void gptCb(GPTDriver* gpt);
+    uint32_t expansionVal_;
+    static void SampleI();
+    static void extCb(EXTDriver* ext, expchannel_t line);
+    void OnEdge(size_t ch);
+    void ApplyConfig(const InputConfig& config);
+    static bool IsValid(const InputConfig& config);
   public:
-    Input() : GPTD_{GPTD2}, semVal_{false}, semCounters_{false}, counters_{}, binaryVal_{}
-    {
-      GPTD_.customData = this;
-    }
-    void Init()
+    Input() : semVal_{false}, semCounters_{false}, semConfig_{false},
+      fifoOverruns_{}, fifoMaxDepth_{}, counters_{}, extChannels_{}, externalMask_{}, hwCounterMask_{},
+      config_{}, binaryVal_{}, expansionVal_{}
+    { }
+    void Init();
+    Rtos::Status SetConfig(const InputConfig& config);
+    InputConfig GetConfig();
+    FifoStat GetFifoStat()
     {
-      Pins::SetConfig<GpioModes::InputFloating>();
-      Pa12::SetConfig<GpioModes::OutputPushPull>();
-      start(NORMALPRIO + 9);
-      gptStart(&GPTD_, &gptconf_);
-      gptStartContinuous(&GPTD_, 200); //500Hz
+      return {fifoOverruns_.load(std::memory_order_relaxed), fifoMaxDepth_.load(std::memory_order_relaxed)};
     }
     uint16_t GetBinaryVal() {
-      uint16_t result = Analog::input.GetBinaryVal();
-      result <<= 3;
-      result = (result & ~(1U << 12)) | uint16_t((result & (1U << 12)) << 1);
+      auto result = uint16_t(AnalogInputMap::Apply(Analog::input.GetBinaryVal()));
       semVal_.wait();
       result |= binaryVal_;
       semVal_.signal();
       return result;
     }
+    uint32_t GetExpansionVal()
+    {
+      Rtos::SemLockGuard lock{semVal_};
+      return expansionVal_;
+    }
+    //All the counters are sampled at the same instant
     counters_buf_t GetCounters()
     {
       counters_buf_t result;
-      semCounters_.wait();
-      std::copy(counters_.begin(), counters_.end(), result.begin());
-      semCounters_.signal();
-      auto Din3Val = result[3];
-      auto adcCounters = Analog::input.GetCounters();
-      std::copy(adcCounters.begin(), adcCounters.end() - 1, &result[3]);
-      result[12] = Din3Val;
-      result[13] = adcCounters.back();
+      Rtos::SemLockGuard lock{semCounters_};
+      Analog::input.ReadCounters([&](const Analog::Input::counters_buf_t& adcCounters) {
+        Rtos::SysLockGuard sysLock;
+        std::copy_n(counters_.begin(), numNativeChannels, result.begin());
+        Utils::ForEachSetBit(hwCounterMask_.load(std::memory_order_relaxed), [&](uint32_t i) {
+          result[i] = uint32_t(timerInput.GetCountI());
+        });
+        auto Din3Val = result[3];
+        std::copy(adcCounters.begin(), adcCounters.end() - 1, &result[3]);
+        result[12] = Din3Val;
+        result[13] = adcCounters.back();
+      });
+      return result;
+    }
+    expansion_counters_buf_t GetExpansionCounters()
+    {
+      expansion_counters_buf_t result;
+      Rtos::SemLockGuard lock{semCounters_};
+      std::copy_n(counters_.begin() + numNativeChannels, numExpansionChannels, result.begin());
       return result;
     }
 
@@ -84,23 +153,30 @@ using namespace Mcudrv;
       uint32_t previousVal{};
       while(true) {
         uint32_t val;
-        if(fifo_.pop(val) == false) {
-          sleep(MS2ST(1));
-          continue;
+        {
+          //Woken up by the sampling timer on each pushed sample. The check and the suspend are in one
+          //critical section, so a sample pushed in between can't be left until the next one.
+          Rtos::SysLockGuard lock;
+          while(fifo_.pop(val) == false) {
+            stayPoint_.SuspendS();
+          }
         }
+        val = debouncer_.Process(val);
         if(val != previousVal) {
-          semCounters_.wait();
-          for(size_t i = 0; i < numChannels; ++i) {
-            if((val & (1U << i)) > (previousVal & (1U << i))) {
-              ++counters_[i];
-            }
+          //Interrupt driven and hardware counted channels are skipped
+          uint32_t changedMask = (val ^ previousVal) & ~externalMask_.load(std::memory_order_relaxed);
+          Utils::ForEachSetBit(changedMask & nativeMask, [val](uint32_t i) {
+            eventLog.Push(NativeEventChannel(i), val & (1U << i));
+          });
+          uint32_t risingMask = changedMask & val;
+          if(risingMask) {
+            Rtos::SemLockGuard lock{semCounters_};
+            Utils::ForEachSetBit(risingMask, [this](uint32_t i) { ++counters_[i]; });
           }
-          semCounters_.signal();
           previousVal = val;
-          //Din3 shifted according connector position
-          val = (val & (uint32_t)~0b1000) | uint32_t((val & 0b1000) << 9);
-          Rtos::SemLockGuard{semVal_};
-          binaryVal_ = static_cast<uint16_t>(val);
+          Rtos::SemLockGuard lock{semVal_};
+          binaryVal_ = static_cast<uint16_t>(NativeInputMap::Apply(val));
+          expansionVal_ = val >> numNativeChannels;
         }
       }
     }
@@ -22,12 +22,19 @@
 #ifndef DIGITALOUT_H
 #define DIGITALOUT_H
 
+
 #include "ch_extended.h"
+#include "cyclecounter.h"
 #include "hal.h"
 #include "type_traits_ex.h"
 #include <utility>
 #include <array>
 
+//Number of the chained 74HC595, the first two are on the board, the rest are daisy chained from QH'
+#ifndef DOUT_CHAIN_LENGTH
+#define DOUT_CHAIN_LENGTH 2
+#endif
+
 namespace Digital {
   class OutputCommand
   {
@@ -37,19 +44,33 @@ namespace Digital {
       Clear,
       SetAndClear,
       Write,
-      Toggle
+      Toggle,
+      Refresh
     };
   private:
     static constexpr size_t busWidth_ = 16;
+    static constexpr size_t chainLength_ = DOUT_CHAIN_LENGTH;
+    static_assert(chainLength_ >= 2 && chainLength_ <= 16, "Unsupported output chain length");
     using ex_value_t = Utils::SelectSize_t<busWidth_ * 2>;
     ex_value_t value_;
     Mode mode_;
+    uint8_t word_;
+    bool deferred_;
   public:
     using value_type = Utils::SelectSize_t<busWidth_>;
     static constexpr size_t GetBusWidth()
     {
       return busWidth_;
     }
+    static constexpr size_t GetChainLength()
+    {
+      return chainLength_;
+    }
+    //Bus words over the whole chain, the word 0 are the outputs of the board
+    static constexpr size_t GetNumWords()
+    {
+      return (chainLength_ + 1) / 2;
+    }
     std::pair<Mode, ex_value_t> Get() const
     {
       return {mode_, value_};
@@ -62,6 +83,14 @@ namespace Digital {
     {
       return mode_;
     }
+    size_t GetWord() const
+    {
+      return word_;
+    }
+    bool IsDeferred() const
+    {
+      return deferred_;
+    }
     void SetValue(ex_value_t value)
     {
       value_ = value;
@@ -70,6 +99,17 @@ namespace Digital {
     {
       mode_ = mode;
     }
+    //Deferred command only updates the image, the chain is latched by the next regular one,
+    //so several words switch at the same instant
+    Rtos::Status SetWord(size_t word, bool deferred = false)
+    {
+      if(word >= GetNumWords()) {
+        return Rtos::Status::Failure;
+      }
+      word_ = uint8_t(word);
+      deferred_ = deferred;
+      return Rtos::Status::Success;
+    }
     Rtos::Status Set(Mode mode, ex_value_t value)
     {
       if(mode != Mode::SetAndClear && value > Utils::NumberToMask_v<busWidth_>) {
@@ -81,15 +121,32 @@ namespace Digital {
     }
   };
 
+  /*
+   * The chain image is clocked out by SPI DMA and latched at once with RCLK from the transfer end callback,
+   * so all the outputs switch in lockstep and the update latency doesn't depend on the CPU load.
+   * The outputs are changed by the thread and by the pulse timer ISR, both under the system lock.
+   * A change during the transfer is sent by the end callback.
+   */
   class Output : Rtos::BaseStaticThread<256>
   {
+  public:
+    static constexpr size_t numOutputs = OutputCommand::GetChainLength() * 8;
+    //Lower bound of an update, the time to clock the chain out at the SPI rate set in spicfg_
+    static constexpr uint32_t spiClock = STM32_PCLK1 / 2;
+    static constexpr uint32_t shiftTimeNs = uint32_t(numOutputs * 1000000000ULL / spiClock);
   private:
-    using pinmap_t = std::array<uint16_t, OutputCommand::GetBusWidth()>;
+    //Output i is driven by the shift register bit PinMap::Destination(i)
+    using PinMap = Utils::BitPermutation<7, 0, 6, 1, 5, 2, 4, 3, 15, 8, 14, 9, 13, 10, 12, 11>;
     using value_t = OutputCommand::value_type;
+    static constexpr size_t chainLength_ = OutputCommand::GetChainLength();
+    using image_t = std::array<uint8_t, chainLength_>;
     static const SPIConfig spicfg_;
-    static const pinmap_t pinMap_;
     SPIDriver* const SPID_;
-    value_t mappedVal_, rawVal_;
+    std::array<value_t, OutputCommand::GetNumWords()> rawVal_;
+    image_t image_;
+    bool pending_;
+    uint32_t startCycles_;
+    volatile uint32_t updateCycles_;
     void main() override
     {
       using Mode = OutputCommand::Mode;
@@ -97,62 +154,114 @@ namespace Digital {
         /* Waiting for a queued message then retrieving it.*/
         thread_t *tp = chMsgWait();
         OutputCommand& cmd = *reinterpret_cast<OutputCommand*>(chMsgGet(tp));
-        value_t value = static_cast<value_t>(cmd.GetValue());
-        switch(cmd.GetMode()) {
-        case Mode::Set:
-          rawVal_ |= value;
-          break;
-        case Mode::Clear:
-          rawVal_ &= ~value;
-          break;
-        case Mode::SetAndClear:
-          rawVal_ |= value & Utils::NumberToMask_v<OutputCommand::GetBusWidth()>;
-          rawVal_ &= ~static_cast<value_t>(cmd.GetValue() >> OutputCommand::GetBusWidth());
-          break;
-        case Mode::Write:
-          rawVal_ = value;
-          break;
-        case Mode::Toggle:
-          rawVal_ ^= value;
-          break;
+        {
+          Rtos::SysLockGuard lock;
+          value_t& rawVal = rawVal_[cmd.GetWord()];
+          Apply(rawVal, cmd);
+          cmd.SetValue(rawVal);
+          if(!cmd.IsDeferred()) {
+            UpdateI(cmd.GetMode() == Mode::Refresh);
+          }
         }
-        cmd.SetValue(rawVal_);
         chMsgRelease(tp, MSG_OK);
-        if(auto temp = Remap(rawVal_); mappedVal_ != temp) {
-          mappedVal_ = temp;
-          SpiSend();
-        }
       }
     }
-    void SpiSend()
+    static void Apply(value_t& val, const OutputCommand& cmd)
     {
-      spiSelect(SPID_);
-      spiStartSend(SPID_, 1, &mappedVal_);
+      using Mode = OutputCommand::Mode;
+      value_t value = static_cast<value_t>(cmd.GetValue());
+      switch(cmd.GetMode()) {
+      case Mode::Set:
+        val |= value;
+        break;
+      case Mode::Clear:
+        val &= ~value;
+        break;
+      case Mode::SetAndClear:
+        val |= value & Utils::NumberToMask_v<OutputCommand::GetBusWidth()>;
+        val &= ~static_cast<value_t>(cmd.GetValue() >> OutputCommand::GetBusWidth());
+        break;
+      case Mode::Write:
+        val = value;
+        break;
+      case Mode::Toggle:
+        val ^= value;
+        break;
+      case Mode::Refresh:
+        break;
+      }
     }
-    static uint16_t Remap(uint16_t val)
+    //The last byte is shifted into the first register of the chain
+    image_t MakeImage() const
     {
-      uint16_t result{};
-      for(size_t i{}; i < pinMap_.size(); ++i) {
-        result |= val & (1UL << i) ? pinMap_[i] : 0;
+      image_t image;
+      value_t mapped = Remap(rawVal_[0]);
+      image[chainLength_ - 1] = uint8_t(mapped);
+      image[chainLength_ - 2] = uint8_t(mapped >> 8);
+      for(size_t reg = 2; reg < chainLength_; ++reg) {
+        image[chainLength_ - 1 - reg] = uint8_t(rawVal_[reg / 2] >> (reg % 2 * 8));
       }
-      return result;
+      return image;
+    }
+    //The image buffer is only written while the DMA is idle
+    void UpdateI(bool refresh = false)
+    {
+      if(SPID_->state == SPI_ACTIVE) {
+        pending_ = true;
+        return;
+      }
+      pending_ = false;
+      if(auto temp = MakeImage(); image_ != temp || refresh) {
+        image_ = temp;
+        startCycles_ = Utils::CycleCounter::Get();
+        spiSelectI(SPID_);
+        spiStartSendI(SPID_, image_.size(), image_.data());
+      }
+    }
+    static void SpiEndCallback(SPIDriver* spid);
+    static uint16_t Remap(uint16_t val)
+    {
+      return uint16_t(PinMap::Apply(val));
     }
   public:
-    Output() : SPID_{&SPID2}, mappedVal_{}, rawVal_{}
+    Output() : SPID_{&SPID2}, rawVal_{}, image_{}, pending_{}, startCycles_{}, updateCycles_{}
     { }
     void Init()
     {
       palSetPadMode(GPIOB, 13, PAL_MODE_STM32_ALTERNATE_PUSHPULL);            // CLK
       palSetPadMode(spicfg_.ssport, spicfg_.sspad, PAL_MODE_OUTPUT_PUSHPULL); // RCLK
       palSetPadMode(GPIOB, 15, PAL_MODE_STM32_ALTERNATE_PUSHPULL);            // MOSI
+      Utils::CycleCounter::Enable();
       spiStart(SPID_, &spicfg_);
-      SpiSend();
+      {
+        Rtos::SysLockGuard lock;
+        UpdateI(true);
+      }
       start(NORMALPRIO);
     }
     msg_t SendMessage(OutputCommand& msg)
     {
       return chMsgSend(thread_ref, reinterpret_cast<msg_t>(&msg));
     }
+    //Command from an ISR, the system lock is held
+    void ExecuteI(const OutputCommand& cmd)
+    {
+      Apply(rawVal_[cmd.GetWord()], cmd);
+      UpdateI();
+    }
+    //Pulse timer edge, the system lock is held
+    void PulseI(size_t ch, bool on)
+    {
+      value_t& rawVal = rawVal_[ch / OutputCommand::GetBusWidth()];
+      value_t mask = value_t(1U << (ch % OutputCommand::GetBusWidth()));
+      rawVal = on ? rawVal | mask : rawVal & ~mask;
+      UpdateI();
+    }
+    //Core cycles from the transfer start to the latch of the last update
+    uint32_t GetUpdateCycles() const
+    {
+      return updateCycles_;
+    }
     ~Output() override
     {
       spiStop(SPID_);
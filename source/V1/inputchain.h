@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef INPUTCHAIN_H
+#define INPUTCHAIN_H
+
+#include "hal.h"
+#include "pinlist.h"
+
+//Number of the chained 74HC165 on the input expansion connector
+#ifndef DIN_CHAIN_LENGTH
+#define DIN_CHAIN_LENGTH 0
+#endif
+
+namespace Digital {
+using namespace Mcudrv;
+
+  /*
+   * Chain of 74HC165 on SPI1 (remapped, JTAG disabled): Pb3 - CLK, Pb4 - QH of the first register, Pb5 - SH/LD.
+   * The chain is read by the input sampling timer ISR together with the native inputs,
+   * bit i of the result is the input Di%8 of the register i/8, the first register is the nearest to the MCU.
+   * SPI1 DMA channels are shared with USART3 (Modbus), so the bytes are polled: at 9MHz SCK
+   * a byte is shifted in faster than an interrupt is entered and left.
+   */
+  template<size_t length>
+  class InputChain
+  {
+  public:
+    static constexpr size_t numChannels = length * 8;
+  private:
+    static_assert(length <= 3, "Native and expansion inputs must fit a sample word");
+    using Clk = Pb3;
+    using Data = Pb4;
+    using Load = Pb5;
+    //SH/LD pulse width and recovery time before the first clock, ~100ns at 3.3V
+    static void Wait()
+    {
+      for(volatile uint32_t i = 2; i; --i) { }
+    }
+  public:
+    //The encoder input of the timer input is lost, Pb3 is the chain clock
+    static void Init()
+    {
+      if constexpr(length) {
+        rccEnableAPB2(RCC_APB2ENR_AFIOEN, true);
+        AFIO->MAPR = (AFIO->MAPR & ~AFIO_MAPR_SWJ_CFG) | AFIO_MAPR_SWJ_CFG_JTAGDISABLE | AFIO_MAPR_SPI1_REMAP;
+        Load::Set();
+        Load::SetConfig<GpioModes::OutputPushPull>();
+        Clk::SetConfig<GpioModes::OutputPushPullFastAlternate>();
+        Data::SetConfig<GpioModes::InputFloating>();
+        rccEnableSPI1(true);
+        //Master, mode 0, fPCLK2/8, MSB first: D7 of the register comes first
+        SPI1->CR1 = SPI_CR1_MSTR | SPI_CR1_BR_1 | SPI_CR1_SSM | SPI_CR1_SSI;
+        SPI1->CR1 |= SPI_CR1_SPE;
+      }
+    }
+    static uint32_t ReadI()
+    {
+      uint32_t result{};
+      if constexpr(length) {
+        Load::Clear();
+        Wait();
+        Load::Set();
+        Wait();
+        for(size_t i{}; i < length; ++i) {
+          SPI1->DR = 0;
+          while(!(SPI1->SR & SPI_SR_RXNE)) { }
+          result |= (SPI1->DR & 0xFFUL) << (i * 8);
+        }
+      }
+      return result;
+    }
+  };
+
+  using ExpansionInputs = InputChain<DIN_CHAIN_LENGTH>;
+
+} //Digital
+
+#endif // INPUTCHAIN_H
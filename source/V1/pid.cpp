@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pid.h"
+#include <algorithm>
+
+namespace Analog {
+
+  PidControl pidControl;
+
+  bool PidControl::IsValid(const PidConfig& config)
+  {
+    if(config.periodMs < minPeriodMs || config.periodMs > maxPeriodMs) {
+      return false;
+    }
+    uint16_t outputsUsed{};
+    for(const auto& loop : config.loops) {
+      size_t in = loop.channels & 0xFF, out = loop.channels >> 8;
+      if(loop.enable > 1 || in >= Input::numChannels || out >= numLoops
+         || loop.setpoint > Thresholds<Input::numChannels>::maxValue
+         || loop.outMin > loop.outMax || loop.outMax > Output::Resolution || loop.antiWindup > Conditional) {
+        return false;
+      }
+      //Two enabled loops can't drive the same output
+      if(loop.enable) {
+        if(outputsUsed & (1U << out)) {
+          return false;
+        }
+        outputsUsed |= uint16_t(1U << out);
+      }
+    }
+    return true;
+  }
+
+  //Gains are scaled to the period once, a loop with changed channels restarts bumpless
+  void PidControl::ApplyConfig(const PidConfig& config)
+  {
+    for(size_t i{}; i < numLoops; ++i) {
+      const auto& loop = config.loops[i];
+      auto& state = state_[i];
+      state.kiDt = int64_t(loop.ki) * config.periodMs * 256 / 1000;
+      state.kdDt = int64_t(loop.kd) * 1000 / config.periodMs;
+      if(!loop.enable || loop.channels != config_.loops[i].channels) {
+        state.active = false;
+      }
+    }
+    config_ = config;
+  }
+
+  void PidControl::Init()
+  {
+    PidConfig config;
+    if(sizeof(config) != nvram::eeprom.Read(nvram::Section::PidConfig, config) || !IsValid(config)) {
+      config = config_;
+    }
+    ApplyConfig(config);
+    start(NORMALPRIO + 10);
+  }
+
+  Rtos::Status PidControl::SetConfig(const PidConfig& config, bool persist)
+  {
+    if(!IsValid(config)) {
+      return Rtos::Status::Failure;
+    }
+    {
+      Rtos::SemLockGuard lock{sem_};
+      ApplyConfig(config);
+    }
+    if(persist && sizeof(config) != nvram::eeprom.Write(nvram::Section::PidConfig, config)) {
+      return Rtos::Status::Failure;
+    }
+    return Rtos::Status::Success;
+  }
+
+  /*
+   * cmd holds the present output values on entry, the values of the enabled loops on return.
+   * A loop being enabled starts with the integral at the present output, so the output doesn't jump.
+   */
+  void PidControl::Step(const Input::sample_buf_t& samples, OutputCommand& cmd)
+  {
+    channel_array_t present;
+    for(size_t ch{}; ch < numLoops; ++ch) {
+      present[ch] = cmd.GetValue(ch);
+    }
+    cmd.Clear();
+    for(size_t i{}; i < numLoops; ++i) {
+      const auto& loop = config_.loops[i];
+      auto& state = state_[i];
+      if(!loop.enable) {
+        continue;
+      }
+      size_t out = loop.channels >> 8;
+      int32_t input = samples[loop.channels & 0xFF];
+      int32_t minOut = loop.outMin, maxOut = loop.outMax;
+      if(!state.active) {
+        state.integral = std::clamp<int32_t>(present[out], minOut, maxOut) << 16;
+        state.prevInput = input;
+        state.active = true;
+      }
+      int32_t error = int32_t(loop.setpoint) - input;
+      int64_t pd = int64_t(loop.kp) * error - state.kdDt * (input - state.prevInput);
+      int32_t outNoI = int32_t(std::clamp<int64_t>(pd >> 8, -2 * int32_t(Output::Resolution), 2 * Output::Resolution));
+      int64_t increment = state.kiDt * error;
+      int32_t unclamped = outNoI + (state.integral >> 16);
+      bool saturated = (unclamped >= maxOut && increment > 0) || (unclamped <= minOut && increment < 0);
+      if(loop.antiWindup != Conditional || !saturated) {
+        state.integral = int32_t(std::clamp<int64_t>(state.integral + increment, int64_t(minOut) << 16,
+                                                     int64_t(maxOut) << 16));
+      }
+      state.prevInput = input;
+      state.output = uint16_t(std::clamp(outNoI + (state.integral >> 16), minOut, maxOut));
+      cmd.SetValue(out, state.output);
+    }
+  }
+
+  void PidControl::main()
+  {
+    setName("Pid");
+    systime_t time = chVTGetSystemTimeX();
+    while(true) {
+      uint16_t periodMs;
+      bool enabled{};
+      {
+        Rtos::SemLockGuard lock{sem_};
+        periodMs = config_.periodMs;
+        for(const auto& loop : config_.loops) {
+          enabled = enabled || loop.enable;
+        }
+      }
+      time += MS2ST(periodMs);
+      sleepUntil(time);
+      if(!enabled) {
+        continue;
+      }
+      OutputCommand cmd{};
+      output.SendMessage(cmd);
+      auto samples = input.GetSamples();
+      {
+        Rtos::SemLockGuard lock{sem_};
+        Step(samples, cmd);
+      }
+      //The loops keep control while the Modbus writes are held
+      if(cmd.GetChannelMask()) {
+        cmd.SetImmediate();
+        output.SendMessage(cmd);
+      }
+    }
+  }
+
+} //Analog
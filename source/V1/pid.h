@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PID_H
+#define PID_H
+
+#include "ch_extended.h"
+#include "analogin.h"
+#include "analogout.h"
+#include "at24_impl.h"
+#include <array>
+
+namespace Analog {
+
+  struct PidLoopConfig {
+    uint16_t enable;
+    uint16_t channels;    //input channel in the low byte, output channel in the high one
+    uint16_t setpoint;    //raw input units
+    int16_t kp;           //Q8.8, output units per input unit
+    int16_t ki;           //Q8.8, per second
+    int16_t kd;           //Q8.8, seconds
+    uint16_t outMin, outMax;
+    uint16_t antiWindup;  //PidControl::AntiWindup
+  };
+
+  struct PidConfig {
+    uint16_t periodMs;
+    std::array<PidLoopConfig, OutputCommand::GetChannelNumber()> loops;
+  };
+
+  /*
+   * Fixed point PID loops from the filtered analog inputs to the PWM outputs, all run in one thread
+   * at the common period. The derivative is taken from the measurement, so a setpoint step doesn't kick
+   * the output. The integral is kept in Q16 output units and never leaves the output limits.
+   * A loop owns its output channel while enabled, the other writes to it are overridden.
+   */
+  class PidControl : Rtos::BaseStaticThread<256>
+  {
+  public:
+    static constexpr size_t numLoops = OutputCommand::GetChannelNumber();
+    static constexpr uint16_t minPeriodMs = 1;
+    static constexpr uint16_t maxPeriodMs = 1000;
+    enum AntiWindup : uint16_t {
+      Clamp,        //the integral is limited to the output range
+      Conditional   //and isn't accumulated while the output is saturated in the error direction
+    };
+  private:
+    static_assert(sizeof(PidConfig) <= nvram::Eeprom::SectionSize * 3, "PID section overflow");
+    static_assert(nvram::Eeprom::Fits(nvram::Section::PidConfig, 0, sizeof(PidConfig)),
+                  "PID configuration doesn't fit the configured EEPROM");
+    static_assert(CH_CFG_ST_FREQUENCY % 1000 == 0, "Loop period isn't a whole number of ticks");
+    struct LoopState {
+      int64_t kiDt;       //Q16 output per input unit per period
+      int64_t kdDt;       //Q8 output per input unit change per period
+      int32_t integral;   //Q16 output units
+      int32_t prevInput;
+      uint16_t output;
+      bool active;
+    };
+    PidConfig config_;
+    std::array<LoopState, numLoops> state_;
+    Rtos::BinarySemaphore sem_;
+    static bool IsValid(const PidConfig& config);
+    void ApplyConfig(const PidConfig& config);
+    void Step(const Input::sample_buf_t& samples, OutputCommand& cmd);
+  public:
+    PidControl() : config_{}, state_{}, sem_{false}
+    {
+      config_.periodMs = 10;
+      for(auto& loop : config_.loops) {
+        loop.outMax = Output::Resolution;
+      }
+    }
+    void Init();
+    //Only the tuning changes are stored, a setpoint change alone isn't
+    Rtos::Status SetConfig(const PidConfig& config, bool persist);
+    PidConfig GetConfig()
+    {
+      Rtos::SemLockGuard lock{sem_};
+      return config_;
+    }
+    //Last output of the loop
+    uint16_t GetOutput(size_t loop)
+    {
+      Rtos::SemLockGuard lock{sem_};
+      return state_[loop].output;
+    }
+    void main() override;
+  };
+
+  extern PidControl pidControl;
+
+} //Analog
+
+#endif // PID_H
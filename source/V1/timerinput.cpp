@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "timerinput.h"
+
+namespace Digital {
+
+  TimerInput timerInput;
+
+  void TimerInput::Init()
+  {
+    rccEnableAPB2(RCC_APB2ENR_AFIOEN, true);
+    //Pa15 is JTDI after reset, SWD stays enabled
+    AFIO->MAPR = (AFIO->MAPR & ~(AFIO_MAPR_SWJ_CFG | AFIO_MAPR_TIM2_REMAP))
+                 | AFIO_MAPR_SWJ_CFG_JTAGDISABLE | AFIO_MAPR_TIM2_REMAP_PARTIALREMAP1;
+    Pin::SetConfig<GpioModes::InputFloating>();
+    PinB::SetConfig<GpioModes::InputFloating>();
+    rccEnableTIM2(true);
+    nvicEnableVector(STM32_TIM2_NUMBER, irqPriority);
+    SetMode(Mode::Counter, 1);
+  }
+
+  void TimerInput::SetMode(Mode mode, uint16_t averaging)
+  {
+    Rtos::SysLockGuard lock;
+    tim_->CR1 = 0;
+    tim_->DIER = 0;
+    rccResetTIM2();
+    mode_ = mode;
+    overflows_ = 0;
+    captureOverflows_ = widthOverflows_ = 0;
+    averaging_ = averaging ? averaging : 1;
+    captureValid_ = false;
+    accum_ = capture_ = {};
+    encoderCnt_ = 0;
+    velocitySamples_ = 0;
+    velocityStart_ = 0;
+    encoder_ = {};
+    tim_->ARR = period - 1;
+    tim_->PSC = 0;
+    if(mode == Mode::Counter) {
+      //External clock mode 2, rising edges, no prescaler
+      tim_->SMCR = TIM_SMCR_ECE | (inputFilter * TIM_SMCR_ETF_0);
+      tim_->DIER = TIM_DIER_UIE;
+    }
+    else if(mode == Mode::Encoder) {
+      //Encoder mode 3, IC1 - TI1, IC2 - TI2, non-inverted
+      tim_->CCMR1 = TIM_CCMR1_CC1S_0 | (inputFilter * TIM_CCMR1_IC1F_0)
+                    | TIM_CCMR1_CC2S_0 | (inputFilter * TIM_CCMR1_IC2F_0);
+      tim_->CCER = TIM_CCER_CC1E | TIM_CCER_CC2E;
+      tim_->SMCR = TIM_SMCR_SMS_1 | TIM_SMCR_SMS_0;
+    }
+    else {
+      //IC1 - TI1 rising edge, IC2 - TI1 falling edge, reset on TI1FP1
+      tim_->CCMR1 = TIM_CCMR1_CC1S_0 | (inputFilter * TIM_CCMR1_IC1F_0)
+                    | TIM_CCMR1_CC2S_1 | (inputFilter * TIM_CCMR1_IC2F_0);
+      tim_->CCER = TIM_CCER_CC1E | TIM_CCER_CC2E | TIM_CCER_CC2P;
+      tim_->SMCR = TIM_SMCR_TS_2 | TIM_SMCR_TS_0 | TIM_SMCR_SMS_2;
+      tim_->DIER = TIM_DIER_UIE | TIM_DIER_CC1IE | TIM_DIER_CC2IE;
+    }
+    tim_->EGR = TIM_EGR_UG;
+    tim_->SR = 0;
+    //Only counter overflow generates the update interrupt, the slave reset doesn't
+    tim_->CR1 = TIM_CR1_URS | TIM_CR1_CEN;
+  }
+
+  void TimerInput::ServeInterruptI()
+  {
+    uint32_t sr = tim_->SR & tim_->DIER;
+    tim_->SR = ~sr;
+    //The counter is reset by the capture, so a pending overflow always precedes it
+    if(sr & TIM_SR_UIF) {
+      if(mode_ == Mode::Counter) {
+        overflows_ += period;
+      }
+      else if(++captureOverflows_ > captureTimeout) {
+        captureOverflows_ = widthOverflows_ = 0;
+        captureValid_ = false;
+        accum_ = capture_ = {};
+      }
+    }
+    if(sr & TIM_SR_CC2IF) {
+      widthOverflows_ = captureOverflows_;
+    }
+    if(sr & TIM_SR_CC1IF) {
+      OnCaptureI();
+    }
+  }
+
+  void TimerInput::OnCaptureI()
+  {
+    uint64_t period = (uint64_t(captureOverflows_) << 16) + tim_->CCR1;
+    uint64_t width = (uint64_t(widthOverflows_) << 16) + tim_->CCR2;
+    captureOverflows_ = widthOverflows_ = 0;
+    //The first edge after idle state starts the measurement
+    if(!captureValid_) {
+      captureValid_ = true;
+      return;
+    }
+    accum_.period += period;
+    accum_.width += width;
+    if(++accum_.count >= averaging_) {
+      capture_ = accum_;
+      accum_ = {};
+    }
+  }
+
+} //Digital
+
+OSAL_IRQ_HANDLER(STM32_TIM2_HANDLER)
+{
+  OSAL_IRQ_PROLOGUE();
+  osalSysLockFromISR();
+  Digital::timerInput.ServeInterruptI();
+  osalSysUnlockFromISR();
+  OSAL_IRQ_EPILOGUE();
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TIMERINPUT_H
+#define TIMERINPUT_H
+
+#include "hal.h"
+#include "ch_extended.h"
+#include "pinlist.h"
+
+namespace Digital {
+using namespace Mcudrv;
+
+  /*
+   * TIM2 channel 1/ETR input (Pa15, TIM2 partial remap), the pulses are processed by the timer itself.
+   * Counter: external clock mode 2, the count is extended on the update event, once per 65536 pulses.
+   * Capture: PWM input mode, the counter is reset on each rising edge, CCR1 holds the period
+   *          and CCR2 the pulse width, in timer clock ticks.
+   * Encoder: quadrature encoder interface on channel 1/2 (Pa15/Pb3), both edges of both inputs
+   *          are counted, direction aware. The position is extended by the periodic sampling.
+   */
+  class TimerInput
+  {
+  public:
+    enum class Mode : uint16_t {
+      Counter,
+      Capture,
+      Encoder,
+    };
+    static constexpr uint32_t tickFrequency = STM32_TIMCLK1;
+    static constexpr uint16_t maxAveraging = 256;
+    struct CaptureResult {
+      uint64_t period;  //the sum of periods
+      uint64_t width;   //the sum of pulse widths
+      uint32_t count;   //number of periods in the sum, 0 - no signal
+    };
+    struct Measurement {
+      uint32_t frequency; //mHz
+      uint32_t period;    //ticks, averaged
+      uint32_t width;     //ticks, averaged
+      uint16_t duty;      //0.01%
+    };
+    struct EncoderState {
+      int32_t position;
+      int32_t velocity;   //counts per second
+    };
+    //Sampling rate of the encoder counter, must be high enough to see less than 32768 counts per period
+    static constexpr uint32_t encoderSampleRate = 500;
+    static constexpr uint32_t velocityWindow = encoderSampleRate / 10;
+  private:
+    using Pin = Pa15;
+    using PinB = Pb3;
+    static constexpr uint32_t irqPriority = 7;
+    static constexpr uint32_t period = 0x10000;
+    //ETR and TI1 sampled at fCK_INT with N=4, rejects glitches shorter than ~60ns
+    static constexpr uint32_t inputFilter = 2;
+    //No edges during 1s, the input is considered idle
+    static constexpr uint32_t captureTimeout = tickFrequency / period;
+    TIM_TypeDef* const tim_;
+    Mode mode_;
+    uint64_t overflows_;
+    //Capture state, ISR only
+    uint32_t captureOverflows_, widthOverflows_;
+    uint32_t averaging_;
+    bool captureValid_;
+    CaptureResult accum_;
+    //Published by ISR
+    CaptureResult capture_;
+    //Encoder state, updated by SampleI()
+    uint16_t encoderCnt_;
+    uint32_t velocitySamples_;
+    int32_t velocityStart_;
+    EncoderState encoder_;
+    void OnCaptureI();
+  public:
+    TimerInput() : tim_{TIM2}, mode_{Mode::Counter}, overflows_{},
+      captureOverflows_{}, widthOverflows_{}, averaging_{1}, captureValid_{},
+      accum_{}, capture_{}, encoderCnt_{}, velocitySamples_{}, velocityStart_{}, encoder_{}
+    { }
+    void Init();
+    void SetMode(Mode mode, uint16_t averaging);
+    void ServeInterruptI();
+    //Called at encoderSampleRate
+    void SampleI()
+    {
+      if(mode_ != Mode::Encoder) {
+        return;
+      }
+      uint16_t cnt = uint16_t(tim_->CNT);
+      encoder_.position += int16_t(cnt - encoderCnt_);
+      encoderCnt_ = cnt;
+      if(++velocitySamples_ == velocityWindow) {
+        velocitySamples_ = 0;
+        encoder_.velocity = (encoder_.position - velocityStart_) * int32_t(encoderSampleRate / velocityWindow);
+        velocityStart_ = encoder_.position;
+      }
+    }
+    EncoderState GetEncoder()
+    {
+      Rtos::SysLockGuard lock;
+      return encoder_;
+    }
+    uint64_t GetCount()
+    {
+      Rtos::SysLockGuard lock;
+      return GetCountI();
+    }
+    //An overflow pending while the counter is read is taken into account
+    uint64_t GetCountI()
+    {
+      uint64_t overflows = overflows_;
+      uint32_t cnt = tim_->CNT;
+      if((tim_->SR & TIM_SR_UIF) && cnt < period / 2) {
+        overflows += period;
+      }
+      return overflows + cnt;
+    }
+    CaptureResult GetCapture()
+    {
+      Rtos::SysLockGuard lock;
+      return capture_;
+    }
+    Measurement GetMeasurement()
+    {
+      auto capture = GetCapture();
+      if(!capture.count || !capture.period) {
+        return {};
+      }
+      return {uint32_t(uint64_t(tickFrequency) * 1000 * capture.count / capture.period),
+              uint32_t(capture.period / capture.count),
+              uint32_t(capture.width / capture.count),
+              uint16_t(capture.width * 10000 / capture.period)};
+    }
+  };
+
+  extern TimerInput timerInput;
+
+} //Digital
+
+#endif // TIMERINPUT_H
@@ -85,48 +85,65 @@ namespace Digital {
     }
   };
 
+  /*
+   * The outputs are changed by the thread and by the pulse timer ISR, both under the system lock.
+   * The outputs owned by the software PWM are left to its DMA transfers.
+   */
   class Output : Rtos::BaseStaticThread<256>
   {
-  private:
+  public:
+    static constexpr size_t numOutputs = OutputCommand::GetBusWidth();
     using Pins = Pinlist<Pa5, Pa6, Pa7, Pb0, Pb1, Pb2, Pb13, Pb14, Pb15>;
+  private:
     using value_t = OutputCommand::value_type;
-    value_t prevVal_, curVal_;
+    value_t prevVal_, curVal_, pwmMask_;
     void main() override
     {
-      using Mode = OutputCommand::Mode;
       while(true) {
         /* Waiting for a queued message then retrieving it.*/
         thread_t *tp = chMsgWait();
         OutputCommand& cmd = *reinterpret_cast<OutputCommand*>(chMsgGet(tp));
-        value_t value = static_cast<value_t>(cmd.GetValue());
-        switch(cmd.GetMode()) {
-        case Mode::Set:
-          curVal_ |= value;
-          break;
-        case Mode::Clear:
-          curVal_ &= ~value;
-          break;
-        case Mode::SetAndClear:
-          curVal_ |= value & Utils::NumberToMask_v<OutputCommand::GetBusWidth()>;
-          curVal_ &= ~static_cast<value_t>(cmd.GetValue() >> OutputCommand::GetBusWidth());
-          break;
-        case Mode::Write:
-          curVal_ = value;
-          break;
-        case Mode::Toggle:
-          curVal_ ^= value;
-          break;
+        {
+          Rtos::SysLockGuard lock;
+          Apply(curVal_, cmd);
+          cmd.SetValue(curVal_);
+          UpdateI();
         }
-        cmd.SetValue(curVal_);
         chMsgRelease(tp, MSG_OK);
-        if(prevVal_ != curVal_) {
-          prevVal_ = curVal_;
-          Pins::Write(curVal_);
-        }
+      }
+    }
+    static void Apply(value_t& val, const OutputCommand& cmd)
+    {
+      using Mode = OutputCommand::Mode;
+      value_t value = static_cast<value_t>(cmd.GetValue());
+      switch(cmd.GetMode()) {
+      case Mode::Set:
+        val |= value;
+        break;
+      case Mode::Clear:
+        val &= ~value;
+        break;
+      case Mode::SetAndClear:
+        val |= value & Utils::NumberToMask_v<OutputCommand::GetBusWidth()>;
+        val &= ~static_cast<value_t>(cmd.GetValue() >> OutputCommand::GetBusWidth());
+        break;
+      case Mode::Write:
+        val = value;
+        break;
+      case Mode::Toggle:
+        val ^= value;
+        break;
+      }
+    }
+    void UpdateI()
+    {
+      if(prevVal_ != curVal_) {
+        prevVal_ = curVal_;
+        Pins::Write(curVal_, value_t(~pwmMask_));
       }
     }
   public:
-    Output() : prevVal_{}, curVal_{}
+    Output() : prevVal_{}, curVal_{}, pwmMask_{}
     { }
     void Init()
     {
@@ -137,6 +154,26 @@ namespace Digital {
     {
       return chMsgSend(thread_ref, reinterpret_cast<msg_t>(&msg));
     }
+    //Command from an ISR, the system lock is held
+    void ExecuteI(const OutputCommand& cmd)
+    {
+      Apply(curVal_, cmd);
+      UpdateI();
+    }
+    //Pulse timer edge, the system lock is held
+    void PulseI(size_t ch, bool on)
+    {
+      value_t mask = value_t(1U << ch);
+      curVal_ = on ? curVal_ | mask : curVal_ & ~mask;
+      UpdateI();
+    }
+    //The released outputs get the register state back
+    void SetPwmMaskI(uint32_t mask)
+    {
+      value_t released = pwmMask_ & value_t(~mask);
+      pwmMask_ = value_t(mask);
+      Pins::Write(curVal_, released);
+    }
   };
 
   extern Output output;
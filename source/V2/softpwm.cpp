@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "softpwm.h"
+
+namespace Digital {
+
+  SoftPwm softPwm;
+
+  //Port A is served on the update request, port B on the compare 4 request
+  static const stm32_dma_stream_t* PortStream(size_t port)
+  {
+    return port ? STM32_DMA1_STREAM4 : STM32_DMA1_STREAM5;
+  }
+  static GPIO_TypeDef* PortRegs(size_t port)
+  {
+    return port ? GPIOB : GPIOA;
+  }
+
+  void SoftPwm::Init()
+  {
+    static_assert(IsPortSupported(), "Only ports A and B have the DMA request assigned");
+    static_assert(STM32_TIMCLK2 / (resolution * frequency) <= 0x10000, "Step rate is too low for TIM1");
+    bool busy = dmaStreamAllocate(STM32_DMA1_STREAM5, dmaPriority, nullptr, nullptr);
+    osalDbgAssert(!busy, "stream already allocated");
+    busy = dmaStreamAllocate(STM32_DMA1_STREAM4, dmaPriority, nullptr, nullptr);
+    osalDbgAssert(!busy, "stream already allocated");
+    for(size_t i{}; i < numPorts; ++i) {
+      dmaStreamSetPeripheral(PortStream(i), &PortRegs(i)->BSRR);
+    }
+    rccEnableTIM1(true);
+    rccResetTIM1();
+    TIM1->PSC = 0;
+    TIM1->ARR = STM32_TIMCLK2 / (resolution * frequency) - 1;
+    //Compare 4 fires one timer clock before the update, both ports change together
+    TIM1->CCR4 = TIM1->ARR;
+    TIM1->CCMR2 = 0;
+    TIM1->CCER = 0;
+  }
+
+  Rtos::Status SoftPwm::SetMask(uint32_t mask)
+  {
+    if(mask > Utils::NumberToMask_v<numChannels>) {
+      return Rtos::Status::Failure;
+    }
+    Rtos::SysLockGuard lock;
+    for(size_t ch{}; ch < numChannels; ++ch) {
+      uint32_t bit = 1UL << ch;
+      if((mask & bit) && !(mask_ & bit)) {
+        PlaceI(ch, duty_[ch]);
+      }
+      else if(!(mask & bit) && (mask_ & bit)) {
+        RemoveI(ch, duty_[ch]);
+      }
+    }
+    if(mask && !mask_) {
+      StartI();
+    }
+    else if(!mask && mask_) {
+      StopI();
+    }
+    mask_ = mask;
+    output.SetPwmMaskI(mask);
+    return Rtos::Status::Success;
+  }
+
+  Rtos::Status SoftPwm::SetDuty(size_t ch, uint16_t duty)
+  {
+    if(ch >= numChannels || duty > resolution) {
+      return Rtos::Status::Failure;
+    }
+    Rtos::SysLockGuard lock;
+    uint16_t prevDuty = duty_[ch];
+    duty_[ch] = duty;
+    if(!(mask_ & (1UL << ch)) || prevDuty == duty) {
+      return Rtos::Status::Success;
+    }
+    size_t port = Pins::PortId(ch);
+    RemoveI(ch, prevDuty);
+    PlaceI(ch, duty);
+    /*
+     * The steps already sent in this period don't see the change. If the output state differs from
+     * the new pattern at this point, it is corrected at once instead of waiting for the next period.
+     */
+    size_t remaining = dmaStreamGetTransactionSize(PortStream(port));
+    size_t lastStep = (2 * resolution - remaining - 1) % resolution;
+    bool wasOn = prevDuty > lastStep, isOn = duty > lastStep;
+    if(wasOn != isOn) {
+      PortRegs(port)->BSRR = Bit(ch, isOn);
+    }
+    return Rtos::Status::Success;
+  }
+
+  void SoftPwm::PlaceI(size_t ch, uint16_t duty)
+  {
+    table_t& table = tables_[Pins::PortId(ch)];
+    uint32_t on = Bit(ch, true), off = Bit(ch, false);
+    if(duty && duty < resolution) {
+      table[duty] |= off;
+    }
+    table[0] = (table[0] & ~(on | off)) | (duty ? on : off);
+  }
+
+  void SoftPwm::RemoveI(size_t ch, uint16_t duty)
+  {
+    table_t& table = tables_[Pins::PortId(ch)];
+    table[0] &= ~(Bit(ch, true) | Bit(ch, false));
+    if(duty && duty < resolution) {
+      table[duty] &= ~Bit(ch, false);
+    }
+  }
+
+  //Both streams restart from step 0 to keep the ports in phase
+  void SoftPwm::StartI()
+  {
+    constexpr uint32_t mode = STM32_DMA_CR_DIR_M2P | STM32_DMA_CR_MINC | STM32_DMA_CR_CIRC
+                              | STM32_DMA_CR_PSIZE_WORD | STM32_DMA_CR_MSIZE_WORD | STM32_DMA_CR_PL(dmaPriority);
+    for(size_t i{}; i < numPorts; ++i) {
+      dmaStreamSetMemory0(PortStream(i), tables_[i].data());
+      dmaStreamSetTransactionSize(PortStream(i), resolution);
+      dmaStreamSetMode(PortStream(i), mode);
+      dmaStreamEnable(PortStream(i));
+    }
+    TIM1->CNT = 0;
+    TIM1->SR = 0;
+    TIM1->DIER = TIM_DIER_UDE | TIM_DIER_CC4DE;
+    TIM1->CR1 = TIM_CR1_CEN;
+  }
+
+  void SoftPwm::StopI()
+  {
+    TIM1->CR1 = 0;
+    TIM1->DIER = 0;
+    for(size_t i{}; i < numPorts; ++i) {
+      dmaStreamDisable(PortStream(i));
+    }
+  }
+
+} //Digital
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef SOFTPWM_H
+#define SOFTPWM_H
+
+#include "ch_extended.h"
+#include "hal.h"
+#include "digitalout.h"
+#include <array>
+
+namespace Digital {
+
+  /*
+   * PWM on the digital outputs without per-edge interrupts. TIM1 requests a DMA transfer every step,
+   * the transfer copies the next word of the port pattern table to GPIO BSRR: update event -> DMA1
+   * channel 5 -> port A, compare 4 at the end of the step -> DMA1 channel 4 -> port B.
+   * Step 0 of the table switches the PWM outputs on (or off for the zero duty), step "duty" switches
+   * them off, so a duty change touches at most 3 table words.
+   */
+  class SoftPwm
+  {
+  public:
+    static constexpr uint32_t resolution = 100;  //steps per period
+    static constexpr uint32_t frequency = 200;   //Hz
+    static constexpr size_t numChannels = Output::numOutputs;
+  private:
+    using Pins = Output::Pins;
+    using table_t = std::array<uint32_t, resolution>;
+    static constexpr size_t numPorts = 2;
+    static constexpr uint32_t dmaPriority = 2;
+    static constexpr bool IsPortSupported()
+    {
+      for(size_t ch{}; ch < numChannels; ++ch) {
+        if(Pins::PortId(ch) >= numPorts) {
+          return false;
+        }
+      }
+      return true;
+    }
+    //BSRR bit driving the channel to the given state
+    static constexpr uint32_t Bit(size_t ch, bool on)
+    {
+      return 1UL << (Pins::Position(ch) + (on != Pins::IsInverted(ch) ? 0 : 16));
+    }
+    std::array<table_t, numPorts> tables_;
+    std::array<uint16_t, numChannels> duty_;
+    uint32_t mask_;
+    void PlaceI(size_t ch, uint16_t duty);
+    void RemoveI(size_t ch, uint16_t duty);
+    void StartI();
+    void StopI();
+  public:
+    SoftPwm() : tables_{}, duty_{}, mask_{}
+    { }
+    void Init();
+    //Bit per output driven by the PWM, the rest are left to the output register
+    Rtos::Status SetMask(uint32_t mask);
+    uint32_t GetMask() const
+    {
+      return mask_;
+    }
+    //Duty in steps, 0 - always off, resolution - always on. Kept for the outputs not in the mask.
+    Rtos::Status SetDuty(size_t ch, uint16_t duty);
+    uint16_t GetDuty(size_t ch) const
+    {
+      return duty_[ch];
+    }
+  };
+
+  extern SoftPwm softPwm;
+
+} //Digital
+
+#endif // SOFTPWM_H
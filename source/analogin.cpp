@@ -22,6 +22,7 @@
 
 #include "analogin.h"
 #include "type_traits_ex.h"
+#include "eventlog.h"
 
 namespace Analog {
 
@@ -52,6 +53,8 @@ const ADCConversionGroup Input::adcGroupCfg_ {
 void Input::Init()
 {
   InputPins::SetConfig<GpioModes::InputAnalog>();
+  calibration_.Load();
+  thresholds_.Load();
   start(NORMALPRIO + 10);
   adcStart(&AdcDriver_, nullptr);
   adcStartConversion(&AdcDriver_, &adcGroupCfg_, (adcsample_t*)&dmaBuf_, dmaBufDepth);
@@ -70,37 +73,37 @@ void Input::main()
   sample_buf_t buf;
   size_t AdcRefreshCount{};
   while(true) {
+    Digital::eventLog.Tick();
     if(fifo_.pop(buf) == false) {
       sleep(US2ST(500));
       continue;
     }
-    uint16_t binarySet{}, binaryClear{};
     for(size_t i{}; i < numChannels; ++i) {
       maBuf_[i] = buf[i];
       buf[i] = maBuf_[i];
-      if(buf[i] > highLevelThd) {
-        binarySet |= (1U << i);
-      }
-      if(buf[i] < lowLevelThd) {
-        binaryClear |= (1U << i);
-      }
     }
-    uint16_t positiveTransitionMask = ((binaryVal_ ^ binarySet) & ~binaryVal_);
+    uint16_t binarySet, binaryClear;
+    thresholds_.Process(buf, binarySet, binaryClear);
+    uint16_t positiveTransitionMask = binarySet & ~binaryVal_;
     if(positiveTransitionMask) {
-      Rtos::SemLockGuard{semCounters_};
-      for(size_t i{}; i < numChannels; ++i) {
-        counters_[i] += (positiveTransitionMask >> i) & 0x01;
-      }
+      Rtos::SemLockGuard lock{semCounters_};
+      Utils::ForEachSetBit(positiveTransitionMask, [this](uint32_t i) { ++counters_[i]; });
     }
     uint16_t binaryTemp = (binaryVal_ | binarySet) & ~binaryClear;
     if(binaryTemp != binaryVal_) {
-      Rtos::SemLockGuard{semBinaryVal_};
+      Utils::ForEachSetBit(binaryTemp ^ binaryVal_, [binaryTemp](uint32_t i) {
+        Digital::eventLog.Push(Digital::AnalogEventChannel(i), binaryTemp & (1U << i));
+      });
+      Rtos::SemLockGuard lock{semBinaryVal_};
       binaryVal_ = binaryTemp;
     }
     if(++AdcRefreshCount == 20) {
       AdcRefreshCount = 0;
+      eng_buf_t eng;
+      calibration_.Apply(buf, eng);
       semSamples_.wait();
       samples_ = buf;
+      engSamples_ = eng;
       semSamples_.signal();
     }
   }
@@ -28,6 +28,8 @@
 #include "pinlist.h"
 #include "type_traits_ex.h"
 #include "circularfifo.h"
+#include "calibration.h"
+#include "thresholds.h"
 
 #include <array>
 #include <numeric>
@@ -71,14 +73,14 @@ using namespace Mcudrv;
   public:
     static constexpr size_t numChannels = INPUT_CH_NUMBER;
     static constexpr size_t dmaBufDepth = 2;
-
-    static constexpr size_t lowLevelThd = 4096 / 4;
-    static constexpr size_t highLevelThd = 4096 / 2;
-  private:
     using sample_buf_t = std::array<adcsample_t, numChannels>;
+    using eng_buf_t = std::array<int16_t, numChannels>;
+    using calibration_t = Calibration<numChannels>;
+    using thresholds_t = Thresholds<numChannels>;
+    using counters_buf_t = std::array<uint32_t, numChannels>;
+  private:
     using dma_buf_t = std::array<sample_buf_t, dmaBufDepth>;
     using fifo_t = memory_relaxed_acquire_release::CircularFifo<sample_buf_t, 128>;
-    using counters_buf_t = std::array<uint32_t, numChannels>;
     using InputPins = InputPinsSequence;
 
     dma_buf_t dmaBuf_;
@@ -87,39 +89,64 @@ using namespace Mcudrv;
     ADCDriver& AdcDriver_;
     Rtos::BinarySemaphore semSamples_, semCounters_, semBinaryVal_;
     sample_buf_t samples_;
+    eng_buf_t engSamples_;
+    calibration_t calibration_;
+    thresholds_t thresholds_;
     counters_buf_t counters_;
     uint16_t binaryVal_;
     static const ADCConversionGroup adcGroupCfg_;
   public:
     Input() : fifo_{}, maBuf_{}, AdcDriver_{ADCD1},
       semSamples_{false}, semCounters_{false}, semBinaryVal_{false},
-      samples_{}, counters_{}, binaryVal_{}
+      samples_{}, engSamples_{}, calibration_{}, thresholds_{}, counters_{}, binaryVal_{}
     {
       AdcDriver_.customData = this;
     }
     void Init();
     static void AdcCb(ADCDriver* adcp, adcsample_t* buffer, size_t);
     sample_buf_t GetSamples();
+    eng_buf_t GetEngSamples();
+    calibration_t& GetCalibration()
+    {
+      return calibration_;
+    }
+    thresholds_t& GetThresholds()
+    {
+      return thresholds_;
+    }
     uint16_t GetBinaryVal();
     counters_buf_t GetCounters();
+    //The counters can't change while func runs, so they may be read together with other sources
+    template<typename F>
+    void ReadCounters(F&& func)
+    {
+      Rtos::SemLockGuard lock{semCounters_};
+      func(static_cast<const counters_buf_t&>(counters_));
+    }
     void main() override;
   };
 
   inline Input::sample_buf_t Input::GetSamples()
   {
-    Rtos::SemLockGuard{semSamples_};
+    Rtos::SemLockGuard lock{semSamples_};
     return samples_;
   }
 
+  inline Input::eng_buf_t Input::GetEngSamples()
+  {
+    Rtos::SemLockGuard lock{semSamples_};
+    return engSamples_;
+  }
+
   inline uint16_t Input::GetBinaryVal()
   {
-    Rtos::SemLockGuard{semBinaryVal_};
+    Rtos::SemLockGuard lock{semBinaryVal_};
     return binaryVal_;
   }
 
   inline Input::counters_buf_t Input::GetCounters()
   {
-    Rtos::SemLockGuard{semCounters_};
+    Rtos::SemLockGuard lock{semCounters_};
     return counters_;
   }
 
@@ -32,9 +32,20 @@ static inline void log(const char* str, Ts... ts) {
   chprintf((BaseSequentialStream*)&SD1, str, ts...);
 }
 
+// Sections are SectionSize slots, an object may occupy several consecutive ones.
+// The layout ends at 1.25 KiB and needs a 2 KiB part, see eeprom_conf.h
 enum class Section {
   Reserved,
   Modbus,
+  AnalogCalibration,        // 2 slots
+  AnalogCurves = 4,         // 8 slots, 4 curves by 2 slots
+  AnalogThresholds = 12,    // 2 slots
+  DigitalInput = 14,
+  RateWindows = 15,
+  CounterJournal = 16,      // 16 slots, 4 records by 4 slots
+  LogicProgram = 32,        // 4 slots
+  PidConfig = 36,           // 3 slots
+  AnalogRamps = 39,         // ramp rates, then the dither mask
 };
 
 namespace CAT24C08 {
@@ -47,6 +58,16 @@ namespace CAT24C08 {
   };
 }
 
+namespace CAT24C16 {
+  enum {
+    ADDRESS = 0xA0 >> 1,
+    WRITETIME = 5,
+    PAGES = 128,
+    PAGESIZE = 16,
+    ADDR_LEN = 1
+  };
+}
+
 namespace AT24C02 {
   enum {
     ADDRESS = 0xA0 >> 1,
@@ -65,10 +86,19 @@ static const I2CConfig i2cfg1 = {
 
 class Eeprom
 {
-private:
+public:
   static constexpr size_t SectionSize = 32;
+  static constexpr size_t Capacity = EEPROM_TYPE::PAGES * EEPROM_TYPE::PAGESIZE;
+  static constexpr size_t PageSize = EEPROM_TYPE::PAGESIZE;
+  static constexpr uint32_t WriteTimeMs = EEPROM_TYPE::WRITETIME;
+private:
   Mtd24aa& dev_;
 public:
+  //For the compile time checks of the layout against the configured chip
+  static constexpr bool Fits(Section sec, size_t offset, size_t size)
+  {
+    return uint32_t(sec) * SectionSize + offset + size <= Capacity;
+  }
   Eeprom(Mtd24aa& dev) : dev_{dev}
   { }
   void Init() {
@@ -76,16 +106,32 @@ public:
     palSetPadMode(GPIOB, 9, PAL_MODE_STM32_ALTERNATE_OPENDRAIN);   /* SDA */
     i2cStart(&I2CD1, &i2cfg1);
   }
+  //Sections beyond the capacity of the installed chip are reported as failed transfers
   template<typename T>
-  size_t Write(Section sec, const T& obj)
+  size_t Write(Section sec, const T& obj, size_t offset = 0)
   {
-    uint32_t offset = uint32_t(sec) * SectionSize;
+    if(!Fits(sec, offset, sizeof(obj))) {
+      return 0;
+    }
+    offset += uint32_t(sec) * SectionSize;
     return dev_.write((uint8_t*)&obj, sizeof(obj), offset);
   }
+  //Write cycles are polled for completion, for the time critical writes
+  template<typename T>
+  size_t WritePolled(Section sec, const T& obj, size_t offset = 0)
+  {
+    dev_.set_ack_polling(true);
+    size_t result = Write(sec, obj, offset);
+    dev_.set_ack_polling(false);
+    return result;
+  }
   template<typename T>
-  size_t Read(Section sec, T& obj, size_t size = sizeof(T))
+  size_t Read(Section sec, T& obj, size_t size = sizeof(T), size_t offset = 0)
   {
-    uint32_t offset = uint32_t(sec) * SectionSize;
+    if(!Fits(sec, offset, size)) {
+      return 0;
+    }
+    offset += uint32_t(sec) * SectionSize;
     return dev_.read((uint8_t*)&obj, size, offset);
   }
 };
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "calibration.h"
+
+namespace Analog {
+
+  Curve::Curve()
+  {
+    points_t identity;
+    identity.fill({unusedPoint, 0});
+    identity[0] = {std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::min()};
+    identity[1] = {unusedPoint - 1, unusedPoint - 1};
+    Set(identity);
+  }
+
+  Rtos::Status Curve::Set(const points_t& points)
+  {
+    size_t count{};
+    while(count < maxPoints && points[count].x != unusedPoint) {
+      if(count && points[count].x <= points[count - 1].x) {
+        return Rtos::Status::Failure;
+      }
+      ++count;
+    }
+    if(!count) {
+      return Rtos::Status::Failure;
+    }
+    for(size_t i = count; i < maxPoints; ++i) {
+      if(points[i].x != unusedPoint) {
+        return Rtos::Status::Failure;
+      }
+    }
+    for(size_t i{}; i < maxPoints; ++i) {
+      if(i < count) {
+        x_[i] = points[i].x;
+        y_[i] = points[i].y;
+      }
+      else {
+        x_[i] = unusedPoint;
+        y_[i] = points[count - 1].y;
+      }
+      slope_[i] = 0;
+      if(i + 1 < count) {
+        int64_t dy = int64_t(points[i + 1].y - points[i].y) << 16;
+        int32_t dx = points[i + 1].x - points[i].x;
+        //rounded to nearest
+        int64_t slope = (dy + (dy < 0 ? -dx : dx) / 2) / dx;
+        slope = std::clamp<int64_t>(slope, std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max());
+        slope_[i] = int32_t(slope);
+      }
+    }
+    return Rtos::Status::Success;
+  }
+
+  Curve::points_t Curve::Get() const
+  {
+    points_t points;
+    for(size_t i{}; i < maxPoints; ++i) {
+      points[i] = {x_[i], x_[i] == unusedPoint ? int16_t(0) : y_[i]};
+    }
+    return points;
+  }
+
+} //Analog
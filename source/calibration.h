@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include "hal.h"
+#include "ch_extended.h"
+#include "at24_impl.h"
+
+#include <array>
+#include <limits>
+#include <algorithm>
+
+namespace Analog {
+
+  struct CurvePoint {
+    int16_t x;
+    int16_t y;
+  };
+
+  //Piecewise-linear transfer function, the result is clamped to the end points
+  class Curve
+  {
+  public:
+    static constexpr size_t maxPoints = 16;
+    //x of unused points must be equal to this value, used points go first in ascending order
+    static constexpr int16_t unusedPoint = std::numeric_limits<int16_t>::max();
+    using points_t = std::array<CurvePoint, maxPoints>;
+  private:
+    static_assert(maxPoints == 16, "Search depth is hardcoded");
+    std::array<int16_t, maxPoints> x_, y_;
+    std::array<int32_t, maxPoints> slope_; //Q16.16
+  public:
+    Curve();
+    Rtos::Status Set(const points_t& points);
+    points_t Get() const;
+    //Branchless binary search of the segment, then interpolation
+    int32_t operator()(int32_t x) const
+    {
+      size_t i = size_t(x >= x_[8]) << 3;
+      i += size_t(x >= x_[i + 4]) << 2;
+      i += size_t(x >= x_[i + 2]) << 1;
+      i += size_t(x >= x_[i + 1]);
+      int32_t dx = x - x_[i];
+      dx &= ~(dx >> 31); //below the first point
+      return y_[i] + int32_t((int64_t(dx) * slope_[i] + 0x8000) >> 16);
+    }
+  };
+
+  struct ChannelCalibration {
+    static constexpr int16_t unityGain = 1 << 12;
+    int16_t gain;   //Q4.12
+    int16_t offset;
+    uint8_t curve;  //0 - linear only, 1..numCurves - index of the linearization table
+    uint8_t reserved;
+  };
+
+  template<size_t numChannels>
+  class Calibration
+  {
+  public:
+    static constexpr size_t numCurves = 4;
+    using channels_t = std::array<ChannelCalibration, numChannels>;
+  private:
+    static_assert(sizeof(channels_t) <= nvram::Eeprom::SectionSize * 2, "Calibration section overflow");
+    static_assert(sizeof(Curve::points_t) <= nvram::Eeprom::SectionSize * 2, "Curve section overflow");
+    static constexpr ChannelCalibration defaultChannel_{ChannelCalibration::unityGain, 0, 0, 0};
+    channels_t channels_;
+    //The first one is identity curve that saturates a result to int16_t
+    std::array<Curve, numCurves + 1> curves_;
+    Rtos::BinarySemaphore sem_;
+    static bool IsValid(const ChannelCalibration& cal)
+    {
+      return cal.curve <= numCurves;
+    }
+  public:
+    Calibration() : curves_{}, sem_{false}
+    {
+      channels_.fill(defaultChannel_);
+    }
+    void Load()
+    {
+      static_assert(nvram::Eeprom::Fits(nvram::Section::AnalogCalibration, 0, sizeof(channels_t)),
+                    "Calibration doesn't fit the configured EEPROM");
+      static_assert(nvram::Eeprom::Fits(nvram::Section::AnalogCurves, 0, numCurves * sizeof(Curve::points_t)),
+                    "Curves don't fit the configured EEPROM");
+      channels_t channels;
+      if(sizeof(channels) == nvram::eeprom.Read(nvram::Section::AnalogCalibration, channels)) {
+        for(size_t i{}; i < numChannels; ++i) {
+          channels_[i] = IsValid(channels[i]) ? channels[i] : defaultChannel_;
+        }
+      }
+      for(size_t i{}; i < numCurves; ++i) {
+        Curve::points_t points;
+        if(sizeof(points) == nvram::eeprom.Read(nvram::Section::AnalogCurves, points, sizeof(points), i * sizeof(points))) {
+          curves_[i + 1].Set(points);
+        }
+      }
+    }
+    Rtos::Status SetChannels(const channels_t& channels)
+    {
+      for(const auto& cal : channels) {
+        if(!IsValid(cal)) {
+          return Rtos::Status::Failure;
+        }
+      }
+      {
+        Rtos::SemLockGuard lock{sem_};
+        channels_ = channels;
+      }
+      if(sizeof(channels) != nvram::eeprom.Write(nvram::Section::AnalogCalibration, channels)) {
+        return Rtos::Status::Failure;
+      }
+      return Rtos::Status::Success;
+    }
+    channels_t GetChannels()
+    {
+      Rtos::SemLockGuard lock{sem_};
+      return channels_;
+    }
+    //Index 1..numCurves
+    Rtos::Status SetCurve(size_t index, const Curve::points_t& points)
+    {
+      if(!index || index > numCurves) {
+        return Rtos::Status::Failure;
+      }
+      Curve curve;
+      if(curve.Set(points) != Rtos::Status::Success) {
+        return Rtos::Status::Failure;
+      }
+      {
+        Rtos::SemLockGuard lock{sem_};
+        curves_[index] = curve;
+      }
+      if(sizeof(points) != nvram::eeprom.Write(nvram::Section::AnalogCurves, points, (index - 1) * sizeof(points))) {
+        return Rtos::Status::Failure;
+      }
+      return Rtos::Status::Success;
+    }
+    Curve::points_t GetCurve(size_t index)
+    {
+      Rtos::SemLockGuard lock{sem_};
+      return curves_[index].Get();
+    }
+    //raw -> gain/offset -> linearization, fixed point only, the same path for every channel
+    template<typename InBuf, typename OutBuf>
+    void Apply(const InBuf& in, OutBuf& out)
+    {
+      Rtos::SemLockGuard lock{sem_};
+      for(size_t i{}; i < numChannels; ++i) {
+        const auto& c = channels_[i];
+        int32_t val = ((int32_t(in[i]) * c.gain) >> 12) + c.offset;
+        out[i] = static_cast<int16_t>(curves_[c.curve](val));
+      }
+    }
+  };
+
+} //Analog
+
+#endif // CALIBRATION_H
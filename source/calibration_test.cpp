@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host test and benchmark of the analog calibration kernel, not a part of the firmware build:
+ *   g++ -std=gnu++17 -O2 -Isource/host -Isource -o calibration_test source/calibration_test.cpp && ./calibration_test
+ * The HAL and RTOS wrappers come from source/host, the EEPROM is stubbed below.
+ * The reported time is of the host, the on-target figure is given by "bench cal".
+ */
+
+#include "hal.h"
+#include "ch_extended.h"
+#define AT24_IMPL_H
+namespace nvram {
+  enum class Section {
+    AnalogCalibration = 2,
+    AnalogCurves = 4
+  };
+  struct Eeprom
+  {
+    static constexpr size_t SectionSize = 32;
+    static constexpr bool Fits(Section, size_t, size_t)
+    {
+      return true;
+    }
+    template<typename T>
+    size_t Read(Section, T&, size_t = sizeof(T), size_t = 0)
+    {
+      return 0;
+    }
+    template<typename T>
+    size_t Write(Section, const T&, size_t = 0)
+    {
+      return sizeof(T);
+    }
+  };
+  static Eeprom eeprom;
+}
+#include "calibration.cpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using namespace Analog;
+
+namespace {
+
+  constexpr size_t numChannels = 10;
+  using Cal = Calibration<numChannels>;
+  using in_t = std::array<adcsample_t, numChannels>;
+  using out_t = std::array<int16_t, numChannels>;
+
+  size_t failures;
+
+  void Check(bool cond, const char* what, long a = 0, long b = 0)
+  {
+    if(!cond) {
+      if(failures < 20) {
+        std::printf("FAIL: %s (%ld, %ld)\n", what, a, b);
+      }
+      ++failures;
+    }
+  }
+
+  //The identity curve saturates to its last point
+  int32_t Saturate(int64_t val)
+  {
+    return int32_t(std::clamp<int64_t>(val, std::numeric_limits<int16_t>::min(), Curve::unusedPoint - 1));
+  }
+
+  void TestIdentity()
+  {
+    Cal cal;
+    in_t in;
+    out_t out;
+    for(uint32_t raw{}; raw < 4096; raw += numChannels) {
+      for(size_t ch{}; ch < numChannels; ++ch) {
+        in[ch] = adcsample_t(std::min<uint32_t>(raw + ch, 4095));
+      }
+      cal.Apply(in, out);
+      for(size_t ch{}; ch < numChannels; ++ch) {
+        Check(out[ch] == in[ch], "identity", in[ch], out[ch]);
+      }
+    }
+  }
+
+  void TestGainOffset(std::mt19937& rng)
+  {
+    Cal cal;
+    for(size_t round{}; round < 1000; ++round) {
+      Cal::channels_t channels;
+      for(auto& c : channels) {
+        c = {int16_t(rng()), int16_t(rng()), 0, 0};
+      }
+      Check(cal.SetChannels(channels) == Rtos::Status::Success, "valid channels rejected");
+      in_t in;
+      out_t out;
+      for(auto& v : in) {
+        v = adcsample_t(rng() % 4096);
+      }
+      cal.Apply(in, out);
+      for(size_t ch{}; ch < numChannels; ++ch) {
+        //Arithmetic shift, the Q4.12 product is rounded toward minus infinity
+        int64_t scaled = int64_t(std::floor(double(in[ch]) * channels[ch].gain / 4096.0));
+        int32_t expected = Saturate(scaled + channels[ch].offset);
+        Check(out[ch] == expected, "gain and offset", expected, out[ch]);
+      }
+    }
+  }
+
+  double Interpolate(const Curve::points_t& points, size_t count, double x)
+  {
+    if(x <= points[0].x) {
+      return points[0].y;
+    }
+    for(size_t i{1}; i < count; ++i) {
+      if(x <= points[i].x) {
+        const auto& a = points[i - 1];
+        const auto& b = points[i];
+        return a.y + (x - a.x) * (b.y - a.y) / (b.x - a.x);
+      }
+    }
+    return points[count - 1].y;
+  }
+
+  void TestCurves(std::mt19937& rng)
+  {
+    for(size_t round{}; round < 2000; ++round) {
+      size_t count = 2 + rng() % (Curve::maxPoints - 1);
+      Curve::points_t points;
+      points.fill({Curve::unusedPoint, 0});
+      int32_t x = -2000 + int32_t(rng() % 1000);
+      for(size_t i{}; i < count; ++i) {
+        x += 1 + int32_t(rng() % 600);
+        points[i] = {int16_t(x), int16_t(int32_t(rng() % 60001) - 30000)};
+      }
+      Curve curve;
+      Check(curve.Set(points) == Rtos::Status::Success, "valid curve rejected");
+      for(int32_t in = points[0].x - 50; in <= x + 50; in += 7) {
+        //Rounded to nearest on the host, the kernel slope is rounded as well
+        double expected = Interpolate(points, count, in);
+        int32_t result = curve(in);
+        Check(std::fabs(result - expected) <= 1.0, "interpolation", long(expected), result);
+      }
+      auto back = curve.Get();
+      for(size_t i{}; i < count; ++i) {
+        Check(back[i].x == points[i].x && back[i].y == points[i].y, "curve readback", long(i));
+      }
+    }
+  }
+
+  void TestRejected()
+  {
+    Curve curve;
+    Curve::points_t points;
+    points.fill({Curve::unusedPoint, 0});
+    Check(curve.Set(points) == Rtos::Status::Failure, "empty curve accepted");
+    points[0] = {10, 0};
+    points[1] = {10, 5};
+    Check(curve.Set(points) == Rtos::Status::Failure, "repeated x accepted");
+    points[1] = {20, 5};
+    points[3] = {30, 5};
+    Check(curve.Set(points) == Rtos::Status::Failure, "gap in the points accepted");
+    Cal cal;
+    points[3] = {Curve::unusedPoint, 0};
+    Check(cal.SetCurve(0, points) == Rtos::Status::Failure, "curve 0 is the identity");
+    Check(cal.SetCurve(Cal::numCurves + 1, points) == Rtos::Status::Failure, "curve index past the end");
+    Check(cal.SetCurve(1, points) == Rtos::Status::Success, "valid curve index rejected");
+    Cal::channels_t channels;
+    channels.fill({ChannelCalibration::unityGain, 0, Cal::numCurves + 1, 0});
+    Check(cal.SetChannels(channels) == Rtos::Status::Failure, "channel with a missing curve accepted");
+  }
+
+  //Every channel through a full length curve, the worst case of the kernel
+  void Benchmark(std::mt19937& rng)
+  {
+    Cal cal;
+    Curve::points_t points;
+    for(size_t i{}; i < Curve::maxPoints; ++i) {
+      points[i] = {int16_t(i * 300), int16_t(i * i * 20)};
+    }
+    for(size_t i = 1; i <= Cal::numCurves; ++i) {
+      cal.SetCurve(i, points);
+    }
+    Cal::channels_t channels;
+    for(size_t ch{}; ch < numChannels; ++ch) {
+      channels[ch] = {int16_t(ChannelCalibration::unityGain + ch * 16), int16_t(ch), uint8_t(ch % Cal::numCurves + 1), 0};
+    }
+    cal.SetChannels(channels);
+    constexpr size_t iterations = 2000000;
+    std::array<in_t, 64> inputs;
+    for(auto& in : inputs) {
+      for(auto& v : in) {
+        v = adcsample_t(rng() % 4096);
+      }
+    }
+    out_t out;
+    int32_t sum{};
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i{}; i < iterations; ++i) {
+      cal.Apply(inputs[i % inputs.size()], out);
+      sum += out[i % numChannels];
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    std::printf("%.1f ns per sample set of %zu channels on the host (%d)\n",
+                elapsed.count() / iterations, numChannels, int(sum & 0x01));
+  }
+
+} //namespace
+
+int main()
+{
+  std::mt19937 rng{2024};
+  TestIdentity();
+  TestGainOffset(rng);
+  TestCurves(rng);
+  TestRejected();
+  Benchmark(rng);
+  std::printf(failures ? "%zu failures\n" : "passed\n", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
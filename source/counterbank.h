@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef COUNTERBANK_H
+#define COUNTERBANK_H
+
+#include "digitalin.h"
+#include <array>
+
+namespace Digital {
+
+  /*
+   * 64-bit view of the input counters with remote latch and reset. The 32-bit hardware/software
+   * counters are never reset, the totals are extended on each update and a reset moves the base.
+   * Update() must be called more often than any counter wraps, RateMeter does it every period.
+   */
+  class CounterBank
+  {
+  public:
+    static constexpr size_t numChannels = Input::numChannels;
+    using raw_t = std::array<uint32_t, numChannels>;
+    using counters_t = std::array<uint64_t, numChannels>;
+    enum class Command : uint16_t {
+      None,
+      Latch,
+      LatchAndReset,
+    };
+  private:
+    raw_t last_;
+    counters_t total_, base_, latched_;
+    Rtos::BinarySemaphore sem_;
+    //Has to be called with the semaphore taken, so the snapshots are applied in order
+    raw_t UpdateS()
+    {
+      auto raw = input.GetCounters();
+      for(size_t i{}; i < numChannels; ++i) {
+        total_[i] += uint32_t(raw[i] - last_[i]);
+        last_[i] = raw[i];
+      }
+      return raw;
+    }
+    counters_t CurrentS() const
+    {
+      counters_t result;
+      for(size_t i{}; i < numChannels; ++i) {
+        result[i] = total_[i] - base_[i];
+      }
+      return result;
+    }
+  public:
+    CounterBank() : last_{}, total_{}, base_{}, latched_{}, sem_{false}
+    { }
+    //Returns the raw counters snapshot
+    raw_t Update()
+    {
+      Rtos::SemLockGuard lock{sem_};
+      return UpdateS();
+    }
+    counters_t Get()
+    {
+      Rtos::SemLockGuard lock{sem_};
+      UpdateS();
+      return CurrentS();
+    }
+    counters_t GetLatched()
+    {
+      Rtos::SemLockGuard lock{sem_};
+      return latched_;
+    }
+    //The counters continue from the given values
+    void Restore(const counters_t& counters)
+    {
+      Rtos::SemLockGuard lock{sem_};
+      UpdateS();
+      for(size_t i{}; i < numChannels; ++i) {
+        base_[i] = total_[i] - counters[i];
+      }
+    }
+    Rtos::Status Execute(Command cmd);
+  };
+
+  extern CounterBank counterBank;
+
+} //Digital
+
+#endif // COUNTERBANK_H
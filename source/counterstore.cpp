@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "counterstore.h"
+#include "cyclecounter.h"
+
+namespace Digital {
+
+  static constexpr uint32_t cyclesPerUs = STM32_SYSCLK / 1000000UL;
+  static constexpr size_t recordSize = CounterStore::recordSlots * nvram::Eeprom::SectionSize;
+
+  //Hardware CRC unit, used by this thread only
+  uint32_t CounterStore::Crc(const Record& rec)
+  {
+    CRC->CR = CRC_CR_RESET;
+    CRC->DR = rec.seq;
+    auto words = reinterpret_cast<const uint32_t*>(rec.counters.data());
+    for(size_t i{}; i < sizeof(rec.counters) / sizeof(uint32_t); ++i) {
+      CRC->DR = words[i];
+    }
+    return CRC->DR;
+  }
+
+  //Retriggers of a sagging supply are ignored until the thread rearms the PVD
+  void CounterStore::pvdCb(EXTDriver* /*ext*/, expchannel_t /*line*/)
+  {
+    if(counterStore.pvdArmed_.exchange(false)) {
+      counterStore.powerFail_ = true;
+      counterStore.stayPoint_.ResumeFromISR();
+    }
+  }
+
+  //A record torn by the power loss fails the CRC check and the previous one is used
+  void CounterStore::Restore()
+  {
+    Record best{};
+    bool found{};
+    for(size_t i{}; i < numRecords; ++i) {
+      Record rec;
+      if(sizeof(rec) != nvram::eeprom.Read(nvram::Section::CounterJournal, rec, sizeof(rec), i * recordSize)
+         || rec.crc != Crc(rec)) {
+        continue;
+      }
+      if(!found || int32_t(rec.seq - best.seq) > 0) {
+        best = rec;
+        found = true;
+      }
+    }
+    if(found) {
+      counterBank.Restore(best.counters);
+      seq_ = best.seq;
+      saved_ = best.counters;
+    }
+  }
+
+  void CounterStore::Refresh()
+  {
+    image_.seq = seq_ + 1;
+    image_.counters = counterBank.Get();
+    image_.crc = Crc(image_);
+  }
+
+  //Writes the last refreshed image, the urgent path doesn't take the counters semaphores
+  void CounterStore::Checkpoint(bool urgent)
+  {
+    size_t offset = (image_.seq % numRecords) * recordSize;
+    uint32_t start = Utils::CycleCounter::Get();
+    size_t written = urgent ? nvram::eeprom.WritePolled(nvram::Section::CounterJournal, image_, offset)
+                            : nvram::eeprom.Write(nvram::Section::CounterJournal, image_, offset);
+    uint32_t us = (Utils::CycleCounter::Get() - start) / cyclesPerUs;
+    osalDbgAssert(!urgent || us <= holdUpBudgetMs * 1000, "emergency checkpoint over the hold-up budget");
+    Rtos::SysLockGuard lock;
+    lastWriteUs_ = us;
+    if(urgent) {
+      urgentWriteUs_ = us;
+    }
+    if(written == sizeof(image_)) {
+      seq_ = image_.seq;
+      saved_ = image_.counters;
+    }
+  }
+
+  void CounterStore::Init()
+  {
+    rccEnableCRC(false);
+    Utils::CycleCounter::Enable();
+    Restore();
+    if(EXTD1.state != EXT_ACTIVE) {
+      extStart(&EXTD1, &extcfg_);
+    }
+    static const EXTChannelConfig pvdcfg{EXT_CH_MODE_RISING_EDGE, pvdCb};
+    extSetChannelMode(&EXTD1, pvdLine, &pvdcfg);
+    start(NORMALPRIO + 20);
+  }
+
+  void CounterStore::main()
+  {
+    setName("CounterStore");
+    constexpr uint32_t checkpointPasses = checkpointIntervalMs / refreshIntervalMs;
+    constexpr uint32_t rearmPasses = pvdRearmMs / refreshIntervalMs;
+    uint32_t passes{}, rearm{};
+    Refresh();
+    while(true) {
+      {
+        Rtos::SysLockGuard lock;
+        if(!powerFail_) {
+          stayPoint_.SuspendS(MS2ST(refreshIntervalMs));
+        }
+      }
+      if(powerFail_.exchange(false)) {
+        {
+          Rtos::SysLockGuard lock;
+          ++powerFails_;
+        }
+        Checkpoint(true);
+        rearm = rearmPasses;
+        continue;
+      }
+      Refresh();
+      if(rearm) {
+        rearm = (PWR->CSR & PWR_CSR_PVDO) ? rearmPasses : rearm - 1;
+        if(!rearm) {
+          pvdArmed_ = true;
+        }
+      }
+      if(++passes >= checkpointPasses) {
+        passes = 0;
+        if(image_.counters != saved_) {
+          Checkpoint(false);
+          Refresh();
+        }
+      }
+    }
+  }
+
+  EXTConfig CounterStore::extcfg_{};
+
+  CounterStore counterStore;
+
+} //Digital
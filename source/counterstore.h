@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef COUNTERSTORE_H
+#define COUNTERSTORE_H
+
+#include "counterbank.h"
+#include <atomic>
+
+namespace Digital {
+
+  /*
+   * Counters persistence. The journal is a ring of records in EEPROM, each checkpoint goes
+   * to the next record to spread the wear, the valid record with the highest sequence number
+   * is restored at boot. The record image and its CRC are refreshed periodically, a supply drop
+   * below the PVD threshold triggers an emergency checkpoint of that image: it doesn't wait for
+   * the counters and polls the write cycles instead of sleeping for the worst case time.
+   * The PVD is rearmed once the supply has been back for pvdRearmMs, so a sagging supply
+   * doesn't wear the journal.
+   * The journal ends at 1 KiB, the configured chip is checked for it at compile time.
+   */
+  class CounterStore : Rtos::BaseStaticThread<512>
+  {
+  public:
+    static constexpr uint32_t checkpointIntervalMs = 10 * 60 * 1000;
+    //Counts of the last interval are lost on a power fail
+    static constexpr uint32_t refreshIntervalMs = 100;
+    //The supply has to keep the MCU running for this long after the PVD trips
+    static constexpr uint32_t holdUpBudgetMs = 50;
+    static constexpr uint32_t pvdRearmMs = 1000;
+    static constexpr size_t numRecords = 4;
+    static constexpr size_t recordSlots = 4;
+    struct Stat {
+      uint32_t seq;
+      uint32_t lastWriteUs;   //duration of the last record write
+      uint32_t urgentWriteUs; //duration of the last emergency checkpoint
+      uint32_t powerFails;
+    };
+  private:
+    using counters_t = CounterBank::counters_t;
+    struct Record {
+      uint32_t seq;
+      uint32_t crc;           //of the sequence number and the counters
+      counters_t counters;
+    };
+    static_assert(sizeof(Record) <= recordSlots * nvram::Eeprom::SectionSize, "Counter record overflow");
+    static_assert(nvram::Eeprom::Fits(nvram::Section::CounterJournal, 0,
+                                       numRecords * recordSlots * nvram::Eeprom::SectionSize),
+                  "Counter journal doesn't fit the configured EEPROM");
+    //Records are page aligned, each page is a transfer of under 1 ms at 400 kHz and a write cycle
+    static constexpr size_t recordPages = (sizeof(Record) + nvram::Eeprom::PageSize - 1) / nvram::Eeprom::PageSize;
+    static_assert(recordPages * (nvram::Eeprom::WriteTimeMs + 1) <= holdUpBudgetMs,
+                  "Emergency checkpoint exceeds the hold-up budget");
+    static constexpr expchannel_t pvdLine = 16;
+    //Used if the digital inputs haven't started the driver
+    static EXTConfig extcfg_;
+    Rtos::ThreadStayPoint stayPoint_;
+    std::atomic_bool powerFail_, pvdArmed_;
+    Record image_;
+    counters_t saved_;
+    uint32_t seq_, lastWriteUs_, urgentWriteUs_, powerFails_;
+    static uint32_t Crc(const Record& rec);
+    static void pvdCb(EXTDriver* ext, expchannel_t line);
+    void Restore();
+    void Refresh();
+    void Checkpoint(bool urgent);
+  public:
+    CounterStore() : powerFail_{}, pvdArmed_{true}, image_{}, saved_{}, seq_{}, lastWriteUs_{}, urgentWriteUs_{},
+      powerFails_{}
+    { }
+    void Init();
+    Stat GetStat()
+    {
+      Rtos::SysLockGuard lock;
+      return {seq_, lastWriteUs_, urgentWriteUs_, powerFails_};
+    }
+    void main() override;
+  };
+
+  extern CounterStore counterStore;
+
+} //Digital
+
+#endif // COUNTERSTORE_H
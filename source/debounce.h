@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include "ch_extended.h"
+#include <array>
+
+namespace Digital {
+
+  /*
+   * Vertical counter debouncer, bit i of each counter word is a bit of the channel i counter.
+   * The output of a channel follows its input once the input has differed from the output
+   * for 'depth' consecutive samples. All channels are processed at once with a few logic
+   * operations per counter bit, the cost doesn't depend on the number of channels.
+   */
+  template<size_t numBits = 4>
+  class Debouncer
+  {
+  public:
+    static constexpr uint16_t maxDepth = (1U << numBits) - 1;
+  private:
+    using sliced_t = std::array<uint32_t, numBits>;
+    sliced_t count_, depth_;
+    uint32_t state_;
+  public:
+    //All channels pass the input through
+    Debouncer() : count_{}, depth_{~0U}, state_{}
+    { }
+    //Depth 0 and 1 pass the input through, channels beyond the buffer aren't filtered
+    template<typename DepthBuf>
+    void SetDepth(const DepthBuf& depth)
+    {
+      sliced_t sliced{};
+      sliced[0] = ~0U << depth.size();
+      for(size_t ch{}; ch < depth.size(); ++ch) {
+        uint32_t d = depth[ch] ? depth[ch] : 1;
+        for(size_t bit{}; bit < numBits; ++bit) {
+          sliced[bit] |= ((d >> bit) & 0x01) << ch;
+        }
+      }
+      //The reader is lock-free, a torn update affects a single sample at most
+      Rtos::SysLockGuard lock;
+      depth_ = sliced;
+      count_ = {};
+    }
+    uint32_t Process(uint32_t in)
+    {
+      uint32_t delta = in ^ state_;
+      //Counters are incremented where the input differs from the output and cleared elsewhere
+      uint32_t carry = delta;
+      uint32_t match = ~0U;
+      for(size_t bit{}; bit < numBits; ++bit) {
+        uint32_t sum = (count_[bit] ^ carry) & delta;
+        carry &= count_[bit];
+        count_[bit] = sum;
+        match &= ~(sum ^ depth_[bit]);
+      }
+      uint32_t toggle = delta & match;
+      state_ ^= toggle;
+      for(auto& c : count_) {
+        c &= ~toggle;
+      }
+      return state_;
+    }
+  };
+
+} //Digital
+
+#endif // DEBOUNCE_H
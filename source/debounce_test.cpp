@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host test of the vertical counter debouncer, not a part of the firmware build:
+ *   g++ -std=gnu++17 -Isource -Iutils -o debounce_test source/debounce_test.cpp && ./debounce_test
+ * The RTOS lock is stubbed, the kernel itself has no other dependencies.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#define CH_EXTENDED_H
+namespace Rtos {
+  struct SysLockGuard { SysLockGuard() {} };
+}
+#include "debounce.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using Digital::Debouncer;
+
+namespace {
+
+  constexpr size_t numChannels = 12;
+  using depth_t = std::array<uint16_t, numChannels>;
+
+  //Straightforward per-channel model of the same rule
+  struct Reference
+  {
+    std::array<uint32_t, numChannels> count{};
+    uint32_t state{};
+    depth_t depth{};
+    uint32_t Process(uint32_t in)
+    {
+      for(size_t ch{}; ch < numChannels; ++ch) {
+        uint32_t bit = 1U << ch;
+        uint32_t d = depth[ch] ? depth[ch] : 1;
+        if((in ^ state) & bit) {
+          if(++count[ch] == d) {
+            state ^= bit;
+            count[ch] = 0;
+          }
+        }
+        else {
+          count[ch] = 0;
+        }
+      }
+      return state;
+    }
+  };
+
+  size_t failures;
+
+  void Check(bool cond, const char* what, size_t step)
+  {
+    if(!cond) {
+      std::printf("FAIL: %s at sample %zu\n", what, step);
+      ++failures;
+    }
+  }
+
+  size_t RisingEdges(uint32_t prev, uint32_t cur, size_t ch)
+  {
+    return (cur & ~prev) >> ch & 0x01;
+  }
+
+  /*
+   * Each channel makes 'transitions' clean level changes, every one preceded by a burst of bounce
+   * shorter than the depth. The debounced output must show exactly one rising edge per high level,
+   * and reach each level exactly 'depth' samples after the bounce has settled.
+   */
+  void TestBounceBursts(std::mt19937& rng)
+  {
+    constexpr size_t transitions = 200;
+    depth_t depth;
+    for(size_t ch{}; ch < numChannels; ++ch) {
+      depth[ch] = uint16_t(ch % Debouncer<>::maxDepth + 1);
+    }
+    Debouncer<> deb;
+    deb.SetDepth(depth);
+    std::array<size_t, numChannels> expected{}, counted{};
+    std::array<uint32_t, numChannels> level{};
+    //Channels are driven independently, the bursts and hold times differ per channel
+    std::array<std::vector<uint32_t>, numChannels> waves;
+    for(size_t ch{}; ch < numChannels; ++ch) {
+      auto& wave = waves[ch];
+      for(size_t t{}; t < transitions; ++t) {
+        uint32_t next = level[ch] ^ 1;
+        size_t bounces = depth[ch] > 1 ? rng() % 6 : 0;
+        for(size_t b{}; b < bounces; ++b) {
+          //Glitches shorter than the depth never reach the output
+          size_t width = 1 + rng() % (depth[ch] - 1);
+          wave.insert(wave.end(), width, next);
+          wave.insert(wave.end(), 1 + rng() % 3, level[ch]);
+        }
+        wave.insert(wave.end(), depth[ch] + rng() % 8, next);
+        level[ch] = next;
+        expected[ch] += next;
+      }
+    }
+    size_t length{};
+    for(const auto& wave : waves) {
+      length = std::max(length, wave.size());
+    }
+    uint32_t prev{};
+    for(size_t step{}; step < length; ++step) {
+      uint32_t in{};
+      for(size_t ch{}; ch < numChannels; ++ch) {
+        const auto& wave = waves[ch];
+        in |= (step < wave.size() ? wave[step] : wave.back()) << ch;
+      }
+      uint32_t out = deb.Process(in);
+      for(size_t ch{}; ch < numChannels; ++ch) {
+        counted[ch] += RisingEdges(prev, out, ch);
+      }
+      prev = out;
+    }
+    for(size_t ch{}; ch < numChannels; ++ch) {
+      Check(counted[ch] == expected[ch], "edge count on bounce bursts", ch);
+      Check(((prev >> ch) & 0x01) == level[ch], "final level", ch);
+    }
+  }
+
+  //Random inputs against the reference, depth changes included
+  void TestAgainstReference(std::mt19937& rng)
+  {
+    Debouncer<> deb;
+    Reference ref;
+    uint32_t base{};
+    for(size_t step{}; step < 200000; ++step) {
+      if(step % 20000 == 0) {
+        for(auto& d : ref.depth) {
+          d = uint16_t(rng() % (Debouncer<>::maxDepth + 1));
+        }
+        deb.SetDepth(ref.depth);
+        ref.count = {};
+      }
+      //Mostly stable inputs with a varying amount of noise
+      uint32_t noise = (rng() & rng() & rng()) & ((1U << numChannels) - 1);
+      if(rng() % 50 == 0) {
+        base ^= 1U << (rng() % numChannels);
+      }
+      uint32_t in = base ^ noise;
+      uint32_t out = deb.Process(in);
+      Check(out == ref.Process(in), "output against the reference model", step);
+      if(failures) {
+        return;
+      }
+    }
+  }
+
+  //Depth 0 and 1 follow the input at once, channels beyond the depth buffer aren't filtered
+  void TestPassThrough()
+  {
+    Debouncer<> deb;
+    std::array<uint16_t, 2> depth{0, 1};
+    deb.SetDepth(depth);
+    uint32_t inputs[] = {0x0, 0xFFFF, 0x5555, 0xAAAA, 0x1, 0x0};
+    for(size_t i{}; i < std::size(inputs); ++i) {
+      Check(deb.Process(inputs[i]) == inputs[i], "pass through", i);
+    }
+  }
+
+} //namespace
+
+int main()
+{
+  std::mt19937 rng{12345};
+  TestPassThrough();
+  TestBounceBursts(rng);
+  TestAgainstReference(rng);
+  std::printf(failures ? "%zu failures\n" : "passed\n", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "eventlog.h"
+#include <algorithm>
+
+namespace Digital {
+
+  size_t EventLog::Read(uint16_t ack, Event* buf, size_t maxCount, uint16_t& firstSeq)
+  {
+    Rtos::SysLockGuard lock;
+    uint16_t advance = uint16_t(ack - uint16_t(readSeq_));
+    if(advance <= writeSeq_ - readSeq_) {
+      readSeq_ += advance;
+    }
+    //Overwritten events are skipped
+    if(writeSeq_ - readSeq_ > capacity) {
+      readSeq_ = writeSeq_ - capacity;
+    }
+    firstSeq = uint16_t(readSeq_);
+    size_t count = std::min<size_t>(writeSeq_ - readSeq_, maxCount);
+    for(size_t i{}; i < count; ++i) {
+      buf[i] = ring_[(readSeq_ + i) % capacity];
+    }
+    return count;
+  }
+
+  EventLog eventLog;
+
+} //Digital
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include "ch_extended.h"
+#include "cyclecounter.h"
+#include "type_traits_ex.h"
+#include <array>
+
+namespace Digital {
+
+  //Event channel is the bit position of the input in the digital input register
+#if BOARD_VER == 1
+  //Din3 and the last analog input follow the connector positions
+  using NativeInputMap = Utils::BitPermutation<0, 1, 2, 12>;
+  using AnalogInputMap = Utils::BitPermutation<3, 4, 5, 6, 7, 8, 9, 10, 11, 13>;
+  constexpr uint8_t NativeEventChannel(size_t ch)
+  {
+    return uint8_t(NativeInputMap::Destination(ch));
+  }
+  constexpr uint8_t AnalogEventChannel(size_t ch)
+  {
+    return uint8_t(AnalogInputMap::Destination(ch));
+  }
+#else
+  constexpr uint8_t AnalogEventChannel(size_t ch)
+  {
+    return uint8_t(ch);
+  }
+#endif
+
+  /*
+   * Input edges timestamped with the free running microsecond clock extended from DWT cycle counter.
+   * Producers are threads and ISRs, the single consumer is the Modbus thread. When the ring is full
+   * the oldest events are overwritten, the reader sees the loss as a gap in the sequence numbers.
+   * Unlike Utils::CircularFifo this is not lock-free: that FIFO has a single producer and rejects
+   * a push when full, while here the EXT ISR and two threads push and also advance the shared clock.
+   * PushI() is a handful of stores, so the critical section is shorter than the EXT ISR entry itself.
+   */
+  class EventLog
+  {
+  public:
+    static constexpr size_t capacity = 64;
+    static constexpr uint32_t timestampMask = (1UL << 27) - 1;
+    struct Event {
+      uint32_t timestamp;   //us
+      uint8_t channel;
+      bool rising;
+      //Bit 31 - rising edge, bits 30..27 - channel, bits 26..0 - timestamp, wraps every 134s
+      uint32_t Pack() const
+      {
+        return uint32_t(rising) << 31 | uint32_t(channel & 0x0F) << 27 | (timestamp & timestampMask);
+      }
+    };
+  private:
+    static constexpr uint32_t cyclesPerUs = STM32_SYSCLK / 1000000UL;
+    std::array<Event, capacity> ring_;
+    uint32_t writeSeq_, readSeq_;
+    uint32_t lastCycles_, microseconds_;
+    uint32_t NowI()
+    {
+      uint32_t us = (Utils::CycleCounter::Get() - lastCycles_) / cyclesPerUs;
+      //The remainder is kept for the next call
+      lastCycles_ += us * cyclesPerUs;
+      microseconds_ += us;
+      return microseconds_;
+    }
+    void PushI(uint8_t channel, bool rising)
+    {
+      ring_[writeSeq_++ % capacity] = {NowI(), channel, rising};
+    }
+  public:
+    EventLog() : ring_{}, writeSeq_{}, readSeq_{}, lastCycles_{}, microseconds_{}
+    { }
+    void Init()
+    {
+      Utils::CycleCounter::Enable();
+      lastCycles_ = Utils::CycleCounter::Get();
+    }
+    //Has to be called more often than the cycle counter wraps (~59s)
+    void Tick()
+    {
+      Rtos::SysLockGuard lock;
+      NowI();
+    }
+    void Push(uint8_t channel, bool rising)
+    {
+      Rtos::SysLockGuard lock;
+      PushI(channel, rising);
+    }
+    void PushFromISR(uint8_t channel, bool rising)
+    {
+      Rtos::SysLockGuardFromISR lock;
+      PushI(channel, rising);
+    }
+    /*
+     * Events before the acknowledged sequence number (lower 16 bits) are dropped, an out of range
+     * value leaves the cursor unchanged. Up to maxCount of the oldest available events are copied
+     * into buf, firstSeq is the sequence number of the first one.
+     */
+    size_t Read(uint16_t ack, Event* buf, size_t maxCount, uint16_t& firstSeq);
+  };
+
+  extern EventLog eventLog;
+
+} //Digital
+
+#endif // EVENTLOG_H
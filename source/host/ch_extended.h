@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host build stand-in for the RTOS wrappers: the host tests are single threaded, locks do nothing
+ * and threads are never started. The kernel names used by the code under test come along, as with ch.hpp.
+ */
+
+#ifndef CH_EXTENDED_H
+#define CH_EXTENDED_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint32_t systime_t;
+#define CH_CFG_ST_FREQUENCY 1000
+#define NORMALPRIO 128
+#define MS2ST(msec) ((systime_t)(msec))
+inline systime_t chVTGetSystemTimeX()
+{
+  return 0;
+}
+
+namespace Rtos {
+
+  template<size_t stackSize>
+  class BaseStaticThread
+  {
+  public:
+    virtual ~BaseStaticThread() { }
+    virtual void main() = 0;
+    void start(int /*prio*/) { }
+    void setName(const char* /*name*/) { }
+    void sleepUntil(systime_t /*time*/) { }
+  };
+
+  enum class Status {
+    Success,
+    Failure
+  };
+
+  struct SysLockGuard
+  {
+    SysLockGuard() { }
+  };
+
+  struct BinarySemaphore
+  {
+    explicit BinarySemaphore(bool) { }
+  };
+
+  struct SemLockGuard
+  {
+    explicit SemLockGuard(BinarySemaphore&) { }
+  };
+
+}//Rtos
+
+#endif // CH_EXTENDED_H
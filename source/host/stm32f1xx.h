@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host build stand-in for the device header, the register blocks are never accessed by the host tests.
+ */
+
+#ifndef STM32F1XX_H
+#define STM32F1XX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+  volatile uint32_t CRL, CRH, IDR, ODR, BSRR, BRR, LCKR;
+} GPIO_TypeDef;
+
+typedef struct {
+  volatile uint32_t APB2ENR;
+} RCC_TypeDef;
+
+#define GPIOA_BASE 0x40010800UL
+#define GPIOB_BASE 0x40010C00UL
+#define GPIOC_BASE 0x40011000UL
+#define GPIOD_BASE 0x40011400UL
+#define GPIOE_BASE 0x40011800UL
+#define RCC ((RCC_TypeDef*)0x40021000UL)
+#define RCC_APB2ENR_IOPAEN (1U << 2)
+
+#endif // STM32F1XX_H
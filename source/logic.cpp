@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "logic.h"
+#include "cyclecounter.h"
+
+namespace Digital {
+
+  LogicEngine logicEngine;
+
+  //Words taken by the instruction, 0 for an unknown opcode
+  size_t LogicEngine::Length(Op op)
+  {
+    switch(op) {
+    case Op::End:
+    case Op::LdInput:
+    case Op::LdAnalog:
+    case Op::LdOutput:
+    case Op::LdMarker:
+    case Op::LdConst:
+    case Op::And:
+    case Op::Or:
+    case Op::Xor:
+    case Op::Not:
+    case Op::RTrig:
+    case Op::FTrig:
+    case Op::Out:
+    case Op::SetOut:
+    case Op::ResetOut:
+    case Op::Mark:
+      return 1;
+    case Op::Ton:
+    case Op::Tof:
+      return 2;
+    case Op::CntGe:
+      return 3;
+    }
+    return 0;
+  }
+
+  //Every instruction is checked for the operand range and the stack use, the program must be ended by End
+  bool LogicEngine::Verify(const program_t& program)
+  {
+    size_t depth{};
+    for(size_t pc{}; pc < maxWords;) {
+      Op op = Op(program[pc] >> 8);
+      uint8_t operand = uint8_t(program[pc]);
+      size_t length = Length(op);
+      if(!length || pc + length > maxWords) {
+        return false;
+      }
+      size_t pops{}, pushes{}, limit{};
+      switch(op) {
+      case Op::End:
+        return true;
+      case Op::LdInput:
+        pushes = 1, limit = Input::numChannels;
+        break;
+      case Op::LdAnalog:
+        pushes = 1, limit = Analog::Input::numChannels;
+        break;
+      case Op::LdOutput:
+        pushes = 1, limit = OutputCommand::GetBusWidth();
+        break;
+      case Op::LdMarker:
+        pushes = 1, limit = numMarkers;
+        break;
+      case Op::LdConst:
+        pushes = 1, limit = 2;
+        break;
+      case Op::And:
+      case Op::Or:
+      case Op::Xor:
+        pops = 2, pushes = 1, limit = 1;
+        break;
+      case Op::Not:
+        pops = 1, pushes = 1, limit = 1;
+        break;
+      case Op::CntGe:
+        pushes = 1, limit = CounterBank::numChannels;
+        break;
+      case Op::Ton:
+      case Op::Tof:
+        pops = 1, pushes = 1, limit = numTimers;
+        break;
+      case Op::RTrig:
+      case Op::FTrig:
+        pops = 1, pushes = 1, limit = numEdges;
+        break;
+      case Op::Out:
+      case Op::SetOut:
+      case Op::ResetOut:
+        pops = 1, limit = OutputCommand::GetBusWidth();
+        break;
+      case Op::Mark:
+        pops = 1, limit = numMarkers;
+        break;
+      }
+      if(operand >= limit || depth < pops || depth - pops + pushes > maxDepth) {
+        return false;
+      }
+      depth = depth - pops + pushes;
+      pc += length;
+    }
+    return false;
+  }
+
+  /*
+   * The top of the stack is bit 0 of the stack word. No bounds are checked here,
+   * the program is verified when loaded.
+   */
+  LogicEngine::Result LogicEngine::Evaluate(const program_t& program, const Inputs& inputs, State& state)
+  {
+    uint32_t stack{};
+    Result result{};
+    auto Push = [&stack](bool val) { stack = stack << 1 | val; };
+    auto Pop = [&stack] {
+      bool val = stack & 0x01;
+      stack >>= 1;
+      return val;
+    };
+    for(size_t pc{};;) {
+      Op op = Op(program[pc] >> 8);
+      uint8_t n = uint8_t(program[pc]);
+      switch(op) {
+      case Op::End:
+        return result;
+      case Op::LdInput:
+        Push(inputs.digital >> n & 0x01);
+        break;
+      case Op::LdAnalog:
+        Push(inputs.analog >> n & 0x01);
+        break;
+      case Op::LdOutput:
+        Push(inputs.outputs >> n & 0x01);
+        break;
+      case Op::LdMarker:
+        Push(state.markers >> n & 0x01);
+        break;
+      case Op::LdConst:
+        Push(n);
+        break;
+      case Op::And:
+        Push(Pop() & Pop());
+        break;
+      case Op::Or:
+        Push(Pop() | Pop());
+        break;
+      case Op::Xor:
+        Push(Pop() ^ Pop());
+        break;
+      case Op::Not:
+        stack ^= 0x01;
+        break;
+      case Op::CntGe:
+        Push(inputs.counters[n] >= (uint32_t(program[pc + 1]) << 16 | program[pc + 2]));
+        break;
+      case Op::Ton:
+      case Op::Tof: {
+          //Off delay is the on delay of the inverted input with the inverted output
+          bool inverted = op == Op::Tof;
+          uint16_t bit = uint16_t(1U << n);
+          bool in = Pop() != inverted;
+          bool q = bool(state.timerQ & bit) != inverted;
+          bool running = state.timerRunning & bit;
+          if(!in) {
+            running = false;
+            q = false;
+          }
+          else if(!q) {
+            if(!running) {
+              running = true;
+              state.timerStart[n] = inputs.now;
+            }
+            if(inputs.now - state.timerStart[n] >= program[pc + 1]) {
+              running = false;
+              q = true;
+            }
+          }
+          state.timerRunning = running ? state.timerRunning | bit : state.timerRunning & ~bit;
+          state.timerQ = q != inverted ? state.timerQ | bit : state.timerQ & ~bit;
+          Push(q != inverted);
+        }
+        break;
+      case Op::RTrig:
+      case Op::FTrig: {
+          uint16_t bit = uint16_t(1U << n);
+          bool in = Pop();
+          bool prev = state.edges & bit;
+          state.edges = in ? state.edges | bit : state.edges & ~bit;
+          Push(op == Op::RTrig ? in && !prev : !in && prev);
+        }
+        break;
+      case Op::Out:
+        if(Pop()) {
+          result.set |= 1UL << n;
+          result.clear &= ~(1UL << n);
+        }
+        else {
+          result.clear |= 1UL << n;
+          result.set &= ~(1UL << n);
+        }
+        break;
+      case Op::SetOut:
+        if(Pop()) {
+          result.set |= 1UL << n;
+          result.clear &= ~(1UL << n);
+        }
+        break;
+      case Op::ResetOut:
+        if(Pop()) {
+          result.clear |= 1UL << n;
+          result.set &= ~(1UL << n);
+        }
+        break;
+      case Op::Mark:
+        state.markers = Pop() ? state.markers | uint16_t(1U << n) : state.markers & ~uint16_t(1U << n);
+        break;
+      }
+      pc += Length(op);
+    }
+  }
+
+  void LogicEngine::Init()
+  {
+    static_assert(nvram::Eeprom::Fits(nvram::Section::LogicProgram, 0, sizeof(program_t)),
+                  "Logic program doesn't fit the configured EEPROM");
+    program_t program;
+    if(sizeof(program) == nvram::eeprom.Read(nvram::Section::LogicProgram, program) && Verify(program)) {
+      program_ = program;
+      running_ = program[0] != Instruction(Op::End);
+    }
+    start(NORMALPRIO + 5);
+  }
+
+  Rtos::Status LogicEngine::Load(const program_t& program)
+  {
+    if(!Verify(program) || sizeof(program) != nvram::eeprom.Write(nvram::Section::LogicProgram, program)) {
+      return Rtos::Status::Failure;
+    }
+    Rtos::SemLockGuard lock{sem_};
+    program_ = program;
+    state_ = {};
+    running_ = program[0] != Instruction(Op::End);
+    return Rtos::Status::Success;
+  }
+
+  void LogicEngine::Run(bool run)
+  {
+    Rtos::SemLockGuard lock{sem_};
+    if(run && !running_) {
+      state_ = {};
+    }
+    running_ = run;
+  }
+
+  //The outputs not driven by the program are left as they are
+  void LogicEngine::Scan()
+  {
+    if(!running_) {
+      return;
+    }
+    Inputs inputs;
+    OutputCommand cmd{};
+    output.SendMessage(cmd);
+    inputs.outputs = uint32_t(cmd.GetValue());
+    inputs.digital = input.GetBinaryVal();
+    inputs.analog = Analog::input.GetBinaryVal();
+    inputs.counters = input.GetCounters();
+    inputs.now = chVTGetSystemTimeX();
+    Result result;
+    {
+      Rtos::SemLockGuard lock{sem_};
+      if(!running_) {
+        return;
+      }
+      uint32_t start = Utils::CycleCounter::Get();
+      result = Evaluate(program_, inputs, state_);
+      scanCycles_ = Utils::CycleCounter::Get() - start;
+    }
+    if(scanCycles_ > maxScanCycles_) {
+      maxScanCycles_ = scanCycles_;
+    }
+    if(((inputs.outputs | result.set) & ~result.clear) != inputs.outputs) {
+      cmd.Set(OutputCommand::Mode::SetAndClear, result.set | result.clear << OutputCommand::GetBusWidth());
+      output.SendMessage(cmd);
+    }
+  }
+
+  void LogicEngine::main()
+  {
+    setName("Logic");
+    Utils::CycleCounter::Enable();
+    systime_t time = chVTGetSystemTimeX();
+    while(true) {
+      time += MS2ST(scanPeriodMs);
+      sleepUntil(time);
+      Scan();
+    }
+  }
+
+} //Digital
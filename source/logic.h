@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LOGIC_H
+#define LOGIC_H
+
+#include "ch_extended.h"
+#include "digitalin.h"
+#include "digitalout.h"
+#include "counterbank.h"
+#include <array>
+
+namespace Digital {
+
+  /*
+   * Interlocks evaluated on the device every scan, the outputs follow the inputs without the bus round trip.
+   * The program is a single pass over at most maxWords words without jumps, so the scan time is bounded
+   * by the program length. Instruction word: opcode in the high byte, operand in the low one,
+   * CntGe and the timers take the constant from the next words. The results go through a stack of bits.
+   * A program is verified as a whole before it is accepted, Evaluate relies on it and doesn't check again.
+   */
+  class LogicEngine : Rtos::BaseStaticThread<256>
+  {
+  public:
+    static constexpr size_t maxWords = 64;
+    static constexpr size_t maxDepth = 16;
+    static constexpr size_t numTimers = 8;
+    static constexpr size_t numEdges = 16;
+    static constexpr size_t numMarkers = 16;
+    static constexpr uint32_t scanPeriodMs = 2;
+    enum class Op : uint8_t {
+      End,
+      LdInput,    //push the digital input bit
+      LdAnalog,   //push the analog threshold bit
+      LdOutput,   //push the output register bit, as it was at the scan start
+      LdMarker,   //push the marker bit
+      LdConst,    //push the operand (0 or 1)
+      And = 0x10,
+      Or,
+      Xor,
+      Not,
+      CntGe = 0x20, //push counter >= constant, 2 words follow: high and low half
+      Ton = 0x30,   //on delay timer, the preset in ms follows
+      Tof,          //off delay timer, the preset in ms follows
+      RTrig = 0x40, //rising edge of the popped bit
+      FTrig,        //falling edge of the popped bit
+      Out = 0x50,   //pop to the output
+      SetOut,       //pop, set the output if true
+      ResetOut,     //pop, reset the output if true
+      Mark          //pop to the marker
+    };
+    using program_t = std::array<uint16_t, maxWords>;
+    using counters_t = CounterBank::raw_t;
+    struct Inputs {
+      uint32_t digital, analog, outputs;
+      counters_t counters;
+      uint32_t now;   //ms
+    };
+    struct State {
+      std::array<uint32_t, numTimers> timerStart;
+      uint16_t timerRunning, timerQ;
+      uint16_t edges, markers;
+    };
+    struct Result {
+      uint32_t set, clear;
+    };
+    static constexpr uint16_t Instruction(Op op, uint8_t operand = 0)
+    {
+      return uint16_t(uint16_t(op) << 8 | operand);
+    }
+    static bool Verify(const program_t& program);
+    static Result Evaluate(const program_t& program, const Inputs& inputs, State& state);
+  private:
+    static_assert(CH_CFG_ST_FREQUENCY == 1000, "The system time is used as the timers ms");
+    program_t program_;
+    State state_;
+    bool running_;
+    uint32_t scanCycles_, maxScanCycles_;
+    Rtos::BinarySemaphore sem_;
+    static size_t Length(Op op);
+    void Scan();
+  public:
+    LogicEngine() : program_{}, state_{}, running_{}, scanCycles_{}, maxScanCycles_{}, sem_{false}
+    { }
+    void Init();
+    //The program is verified, stored in EEPROM and started from the reset state, it isn't run if not stored
+    Rtos::Status Load(const program_t& program);
+    program_t GetProgram()
+    {
+      Rtos::SemLockGuard lock{sem_};
+      return program_;
+    }
+    //Until the next load or reboot
+    void Run(bool run);
+    bool IsRunning() const
+    {
+      return running_;
+    }
+    //Core cycles of the program evaluation
+    uint32_t GetMaxScanCycles() const
+    {
+      return maxScanCycles_;
+    }
+    void ResetMaxScanCycles()
+    {
+      maxScanCycles_ = 0;
+    }
+    void main() override;
+  };
+
+  extern LogicEngine logicEngine;
+
+} //Digital
+
+#endif // LOGIC_H
@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host test and benchmark of the logic engine, not a part of the firmware build:
+ *   g++ -std=gnu++17 -O2 -Isource/host -Isource -Isource/V1 -Iutils -o logic_test source/logic_test.cpp && ./logic_test
+ * The I/O classes and the EEPROM are stubbed below with the V1 sizes. The reported time is of the host,
+ * the on-target figure is given by "bench logic".
+ */
+
+#include "hal.h"
+#include "ch_extended.h"
+#include <array>
+#define AT24_IMPL_H
+#define CYCLECOUNTER_H
+#define DIGITALIN_H
+#define DIGITALOUT_H
+#define COUNTERBANK_H
+namespace nvram {
+  enum class Section {
+    LogicProgram = 32
+  };
+  struct Eeprom
+  {
+    bool failWrites;
+    static constexpr bool Fits(Section, size_t, size_t)
+    {
+      return true;
+    }
+    template<typename T>
+    size_t Read(Section, T&, size_t = sizeof(T), size_t = 0)
+    {
+      return 0;
+    }
+    template<typename T>
+    size_t Write(Section, const T&, size_t = 0)
+    {
+      return failWrites ? 0 : sizeof(T);
+    }
+  };
+  static Eeprom eeprom;
+}
+namespace Utils {
+  struct CycleCounter
+  {
+    static void Enable() { }
+    static uint32_t Get()
+    {
+      return 0;
+    }
+  };
+}
+namespace Analog {
+  struct Input
+  {
+    static constexpr size_t numChannels = 10;
+    uint32_t GetBinaryVal()
+    {
+      return 0;
+    }
+  };
+  static Input input;
+}
+namespace Digital {
+  struct Input
+  {
+    static constexpr size_t numChannels = 14;
+    uint32_t GetBinaryVal()
+    {
+      return 0;
+    }
+    std::array<uint32_t, numChannels> GetCounters()
+    {
+      return {};
+    }
+  };
+  static Input input;
+  class OutputCommand
+  {
+  public:
+    enum class Mode {
+      SetAndClear
+    };
+    static constexpr size_t GetBusWidth()
+    {
+      return 16;
+    }
+    uint32_t GetValue() const
+    {
+      return 0;
+    }
+    void Set(Mode, uint32_t) { }
+  };
+  struct Output
+  {
+    void SendMessage(OutputCommand&) { }
+  };
+  static Output output;
+  struct CounterBank
+  {
+    static constexpr size_t numChannels = Input::numChannels;
+    using raw_t = std::array<uint32_t, numChannels>;
+  };
+}
+#include "logic.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+
+using namespace Digital;
+using Op = LogicEngine::Op;
+
+namespace {
+
+  size_t failures;
+
+  void Check(bool cond, const char* what, long a = 0, long b = 0)
+  {
+    if(!cond) {
+      if(failures < 20) {
+        std::printf("FAIL: %s (%ld, %ld)\n", what, a, b);
+      }
+      ++failures;
+    }
+  }
+
+  LogicEngine::program_t Program(std::initializer_list<uint16_t> words)
+  {
+    LogicEngine::program_t program;
+    program.fill(LogicEngine::Instruction(Op::End));
+    std::copy(words.begin(), words.end(), program.begin());
+    return program;
+  }
+
+  //Same as "bench logic": the longest instructions fill the whole program
+  LogicEngine::program_t WorstCase()
+  {
+    LogicEngine::program_t program;
+    size_t pc{};
+    for(uint8_t i{}; pc + 7 < LogicEngine::maxWords; ++i) {
+      program[pc++] = LogicEngine::Instruction(Op::CntGe, i % CounterBank::numChannels);
+      program[pc++] = 0;
+      program[pc++] = 1;
+      program[pc++] = LogicEngine::Instruction(Op::Ton, i % LogicEngine::numTimers);
+      program[pc++] = 0;
+      program[pc++] = LogicEngine::Instruction(Op::RTrig, i % LogicEngine::numEdges);
+      program[pc++] = LogicEngine::Instruction(Op::Out, i % OutputCommand::GetBusWidth());
+    }
+    while(pc < LogicEngine::maxWords) {
+      program[pc++] = LogicEngine::Instruction(Op::End);
+    }
+    return program;
+  }
+
+  //Instructions executed by a scan, End included
+  size_t Instructions(const LogicEngine::program_t& program)
+  {
+    size_t count{};
+    for(size_t pc{}; pc < LogicEngine::maxWords; ++count) {
+      Op op = Op(program[pc] >> 8);
+      if(op == Op::End) {
+        return count + 1;
+      }
+      pc += op == Op::CntGe ? 3 : (op == Op::Ton || op == Op::Tof) ? 2 : 1;
+    }
+    return count;
+  }
+
+  //State of output 0 after a scan
+  struct Runner
+  {
+    LogicEngine::program_t program;
+    LogicEngine::Inputs inputs{};
+    LogicEngine::State state{};
+    bool Scan(uint32_t now, bool in0)
+    {
+      inputs.now = now;
+      inputs.digital = in0;
+      auto result = LogicEngine::Evaluate(program, inputs, state);
+      Check(bool(result.set & 0x01) != bool(result.clear & 0x01), "Out drives the output", long(result.set),
+            long(result.clear));
+      return result.set & 0x01;
+    }
+  };
+
+  void TestVerify()
+  {
+    using LE = LogicEngine;
+    Check(LE::Verify(WorstCase()), "worst case program rejected");
+    Check(LE::Verify(Program({})), "empty program rejected");
+    Check(LE::Verify(Program({LE::Instruction(Op::LdInput, 13), LE::Instruction(Op::Out, 15)})), "valid program");
+    Check(!LE::Verify(Program({LE::Instruction(Op::LdInput, 14), LE::Instruction(Op::Out, 0)})), "input range");
+    Check(!LE::Verify(Program({LE::Instruction(Op::LdConst, 2), LE::Instruction(Op::Out, 0)})), "constant range");
+    Check(!LE::Verify(Program({LE::Instruction(Op::LdConst, 1), LE::Instruction(Op::Out, 16)})), "output range");
+    Check(!LE::Verify(Program({LE::Instruction(Op::And)})), "stack underflow");
+    Check(!LE::Verify(Program({0x7F00})), "unknown opcode");
+    LE::program_t overflow = Program({});
+    for(size_t i{}; i <= LE::maxDepth; ++i) {
+      overflow[i] = LE::Instruction(Op::LdConst, 1);
+    }
+    Check(!LE::Verify(overflow), "stack overflow");
+    LE::program_t unterminated;
+    unterminated.fill(LE::Instruction(Op::Not));
+    unterminated[0] = LE::Instruction(Op::LdConst, 0);
+    Check(!LE::Verify(unterminated), "program without End");
+    LE::program_t truncated = unterminated;
+    truncated[LE::maxWords - 2] = LE::Instruction(Op::CntGe, 0);
+    Check(!LE::Verify(truncated), "constant past the end");
+  }
+
+  void TestTon()
+  {
+    Runner r{Program({LogicEngine::Instruction(Op::LdInput, 0), LogicEngine::Instruction(Op::Ton, 3), 10,
+                      LogicEngine::Instruction(Op::Out, 0)})};
+    Check(!r.Scan(100, true), "Ton output at the start");
+    Check(!r.Scan(109, true), "Ton output before the preset", 109);
+    Check(r.Scan(110, true), "Ton output at the preset", 110);
+    Check(r.Scan(500, true), "Ton output held");
+    Check(!r.Scan(501, false), "Ton reset by the input");
+    //A pulse shorter than the preset restarts the timer
+    Check(!r.Scan(600, true), "Ton restarted");
+    Check(!r.Scan(605, false), "Ton short pulse");
+    Check(!r.Scan(606, true), "Ton restarted again");
+    Check(!r.Scan(615, true), "Ton counts from the last rising edge", 615);
+    Check(r.Scan(616, true), "Ton output after the restart", 616);
+  }
+
+  void TestTof()
+  {
+    Runner r{Program({LogicEngine::Instruction(Op::LdInput, 0), LogicEngine::Instruction(Op::Tof, 7), 10,
+                      LogicEngine::Instruction(Op::Out, 0)})};
+    Check(!r.Scan(100, false), "Tof output at the start");
+    Check(r.Scan(101, true), "Tof output follows the input on");
+    Check(r.Scan(200, false), "Tof output held after the input off");
+    Check(r.Scan(209, false), "Tof output before the preset", 209);
+    Check(!r.Scan(210, false), "Tof output off at the preset", 210);
+    //The input back before the preset keeps the output on
+    Check(r.Scan(300, true), "Tof on again");
+    Check(r.Scan(301, false), "Tof off delay started");
+    Check(r.Scan(305, true), "Tof input back");
+    Check(r.Scan(320, false), "Tof off delay restarted");
+    Check(r.Scan(329, false), "Tof off delay from the last falling edge", 329);
+    Check(!r.Scan(330, false), "Tof output off after the restart", 330);
+  }
+
+  void TestEdges()
+  {
+    Runner rise{Program({LogicEngine::Instruction(Op::LdInput, 0), LogicEngine::Instruction(Op::RTrig, 15),
+                         LogicEngine::Instruction(Op::Out, 0)})};
+    Runner fall{Program({LogicEngine::Instruction(Op::LdInput, 0), LogicEngine::Instruction(Op::FTrig, 15),
+                         LogicEngine::Instruction(Op::Out, 0)})};
+    const bool in[]{false, true, true, false, false, true, false, true};
+    bool prev{};
+    for(size_t i{}; i < std::size(in); ++i) {
+      Check(rise.Scan(uint32_t(i), in[i]) == (in[i] && !prev), "RTrig", long(i));
+      Check(fall.Scan(uint32_t(i), in[i]) == (!in[i] && prev), "FTrig", long(i));
+      prev = in[i];
+    }
+  }
+
+  void TestCntGe()
+  {
+    Runner r{Program({LogicEngine::Instruction(Op::CntGe, 13), 0x0001, 0x2345, LogicEngine::Instruction(Op::Out, 0)})};
+    for(uint32_t count : {0UL, 0x2345UL, 0x12344UL, 0x12345UL, 0x12346UL, 0xFFFFFFFFUL}) {
+      r.inputs.counters[13] = count;
+      Check(r.Scan(0, false) == (count >= 0x12345), "CntGe", long(count));
+    }
+    r.inputs.counters.fill(0xFFFFFFFF);
+    r.inputs.counters[13] = 0;
+    Check(!r.Scan(0, false), "CntGe reads its own counter");
+  }
+
+  void TestBitOps()
+  {
+    using LE = LogicEngine;
+    //out0 = in0 & !in1, out1 = in0 | in1, out2 = in0 ^ in1, marker 3 set by in0 and reset by in1
+    auto program = Program({LE::Instruction(Op::LdInput, 0), LE::Instruction(Op::LdInput, 1), LE::Instruction(Op::Not),
+                            LE::Instruction(Op::And), LE::Instruction(Op::Out, 0),
+                            LE::Instruction(Op::LdInput, 0), LE::Instruction(Op::LdInput, 1), LE::Instruction(Op::Or),
+                            LE::Instruction(Op::Out, 1),
+                            LE::Instruction(Op::LdInput, 0), LE::Instruction(Op::LdInput, 1), LE::Instruction(Op::Xor),
+                            LE::Instruction(Op::Out, 2),
+                            LE::Instruction(Op::LdInput, 0), LE::Instruction(Op::LdMarker, 3), LE::Instruction(Op::Or),
+                            LE::Instruction(Op::LdInput, 1), LE::Instruction(Op::Not), LE::Instruction(Op::And),
+                            LE::Instruction(Op::Mark, 3),
+                            LE::Instruction(Op::LdMarker, 3), LE::Instruction(Op::SetOut, 3),
+                            LE::Instruction(Op::LdInput, 1), LE::Instruction(Op::ResetOut, 3)});
+    Check(LE::Verify(program), "bit operations program rejected");
+    LE::Inputs inputs{};
+    LE::State state{};
+    bool marker{};
+    for(uint32_t in : {0U, 1U, 0U, 2U, 3U, 0U, 1U, 1U, 2U}) {
+      inputs.digital = in;
+      auto result = LE::Evaluate(program, inputs, state);
+      bool a = in & 0x01, b = in & 0x02;
+      marker = (a || marker) && !b;
+      uint32_t expected = uint32_t(a && !b) | uint32_t(a || b) << 1 | uint32_t(a != b) << 2 | uint32_t(marker) << 3;
+      Check((result.set & 0x07) == (expected & 0x07) && (result.clear & 0x07) == (~expected & 0x07), "And/Or/Xor/Not",
+            long(in), long(result.set));
+      Check(bool(result.set & 0x08) == marker && bool(result.clear & 0x08) == b, "Mark/SetOut/ResetOut",
+            long(in), long(result.set));
+    }
+  }
+
+  void TestLoad()
+  {
+    LogicEngine engine;
+    auto program = Program({LogicEngine::Instruction(Op::LdInput, 0), LogicEngine::Instruction(Op::Out, 0)});
+    nvram::eeprom.failWrites = true;
+    Check(engine.Load(program) == Rtos::Status::Failure, "store failure reported");
+    Check(!engine.IsRunning() && engine.GetProgram() != program, "program run without being stored");
+    nvram::eeprom.failWrites = false;
+    Check(engine.Load(program) == Rtos::Status::Success, "stored program");
+    Check(engine.IsRunning() && engine.GetProgram() == program, "stored program not run");
+    Check(engine.Load(Program({LogicEngine::Instruction(Op::And)})) == Rtos::Status::Failure, "invalid program loaded");
+    Check(engine.GetProgram() == program, "invalid program replaced the running one");
+  }
+
+  //Each instruction runs once at most, the scan is bounded by the program length
+  void Benchmark()
+  {
+    auto program = WorstCase();
+    constexpr size_t iterations = 1000000;
+    LogicEngine::Inputs inputs{};
+    LogicEngine::State state{};
+    uint32_t outputs{};
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i{}; i < iterations; ++i) {
+      inputs.counters.fill(inputs.now & 0x01);
+      ++inputs.now;
+      outputs ^= LogicEngine::Evaluate(program, inputs, state).set;
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    size_t count = Instructions(program);
+    Check(count <= LogicEngine::maxWords, "instruction bound", long(count));
+    std::printf("worst case program: %zu instructions in %zu words (bound %zu), %.1f ns per scan on the host (%x)\n",
+                count, LogicEngine::maxWords, LogicEngine::maxWords, elapsed.count() / iterations, outputs & 0x01);
+  }
+
+} //namespace
+
+int main()
+{
+  TestVerify();
+  TestTon();
+  TestTof();
+  TestEdges();
+  TestCntGe();
+  TestBitOps();
+  TestLoad();
+  Benchmark();
+  std::printf(failures ? "%zu failures\n" : "passed\n", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -25,9 +25,19 @@
 #include "digitalout.h"
 #include "analogin.h"
 #include "order_conv.h"
+#include "eventlog.h"
+#include "ratemeter.h"
+#include "counterbank.h"
+#include "mbframe.h"
+#include "pulsetimer.h"
+#include "schedule.h"
+#include "logic.h"
 
 #if BOARD_VER == 1
 #include "analogout.h"
+#include "pid.h"
+#else
+#include "softpwm.h"
 #endif
 
 #include <array>
@@ -38,24 +48,780 @@ static const uint8_t UniqProcessorIdLen = 12;
 using Utils::htons;
 using Utils::ntohs;
 using Utils::htonl;
+using Utils::ntohl;
 
 Modbus modbus;
 
 enum Range {
   R_AnalogInputStart = 32,
   R_AnalogInputSize = 10,
+  R_AnalogEngStart = 48,
+  R_AnalogEngSize = Analog::Input::numChannels,
   R_CounterStart = 64,
   R_CounterSize = 14 * 2,
   R_DigitalInputStart = 96,
   R_DigitalInputSize = 1,
+  R_RateStart = 112,
+  R_RateSize = Digital::RateMeter::numChannels * 2,
   R_AnalogOutputStart = 128,
   R_AnalogOutputSize = 4,
+  R_AnalogFineStart = 132,
+  R_AnalogFineSize = 4,
+  R_DitherMaskStart = 136,
+  R_DitherMaskSize = 1,
+  R_AnalogSyncStart = 137,
+  R_AnalogSyncSize = 2,
   R_DigitalOutputStart = 160,
   R_DigitalOutputSize = 4,
+  R_PulseStart = 168,
+  R_PulseSize = 5,
+#if BOARD_VER == 1
+  R_DigitalInputCfgStart = 176,
+  R_DigitalInputCfgSize = 5 + Digital::NATIVE_CH_NUMBER * 2,
+  R_CaptureStart = 224,
+  R_CaptureSize = 7,
+  R_EncoderStart = 232,
+  R_EncoderSize = 4,
+  R_InputDiagStart = 208,
+  R_InputDiagSize = 3,
+  R_ExpansionInputStart = 100,
+  R_ExpansionInputSize = (Digital::Input::numExpansionChannels + 15) / 16,
+  R_ExpansionCounterStart = 144,
+  R_ExpansionCounterSize = Digital::Input::numExpansionChannels * 2,
+  R_OutputChainStart = 448,
+  R_OutputChainSize = Digital::OutputCommand::GetNumWords(),
+  R_PidStart = 736,
+  R_PidRegsPerLoop = 10,
+  R_PidSize = 1 + Analog::PidControl::numLoops * R_PidRegsPerLoop,
+  R_AnalogRampStart = 784,
+  R_AnalogRampSize = Analog::OutputCommand::GetChannelNumber(),
+  R_WaveCtrlStart = 792,
+  R_WaveCtrlSize = 5,
+  R_WaveTableStart = 800,
+  R_WaveTableSize = Analog::Output::maxWavePoints,
+#else
+  R_SoftPwmStart = 176,
+  R_SoftPwmSize = 1 + Digital::SoftPwm::numChannels,
+#endif
   R_SystemStatStart = 192,
-  R_SystemStatSize = 2
+  R_SystemStatSize = 2,
+  R_ThresholdStart = 192,
+  R_ThresholdRegsPerChannel = 2,
+  R_ThresholdSize = Analog::Input::numChannels * R_ThresholdRegsPerChannel,
+  R_Counter64Start = 256,
+  R_Counter64Size = Digital::CounterBank::numChannels * 4,
+  R_LatchedStart = 320,
+  R_LatchedSize = Digital::CounterBank::numChannels * 4,
+  R_RateWindowStart = 224,
+  R_RateWindowSize = Digital::RateMeter::numChannels,
+  R_CounterCmdStart = 240,
+  R_CounterCmdSize = 1,
+  R_CalibrationStart = 256,
+  R_CalibrationRegsPerChannel = 3,
+  R_CalibrationSize = Analog::Input::numChannels * R_CalibrationRegsPerChannel,
+  R_CurveStart = 320,
+  R_CurveRegsPerCurve = Analog::Curve::maxPoints * 2,
+  R_CurveSize = Analog::Input::calibration_t::numCurves * R_CurveRegsPerCurve,
+  R_ScheduleCtrlStart = 512,
+  R_ScheduleCtrlSize = 3,
+  R_ScheduleStart = 520,
+  R_ScheduleRegsPerEntry = 4,
+  R_ScheduleSize = Digital::Schedule::maxEntries * R_ScheduleRegsPerEntry,
+  R_LogicCtrlStart = 656,
+  R_LogicCtrlSize = 2,
+  R_LogicProgramStart = 664,
+  R_LogicProgramSize = Digital::LogicEngine::maxWords
 };
 
+//32-bit values use the same word order as the counters block
+static inline void Put32(uint16_t*& regBuffer16, uint32_t val)
+{
+  uint32_t be32 = htonl(val);
+  *regBuffer16++ = uint16_t(be32 & 0xFFFF);
+  *regBuffer16++ = uint16_t(be32 >> 16);
+}
+
+static inline uint32_t Get32(const uint16_t* regBuffer16)
+{
+  return ntohl(uint32_t(regBuffer16[0]) | uint32_t(regBuffer16[1]) << 16);
+}
+
+/**
+ * Calibration holding registers, 3 per channel: gain (Q4.12), offset, curve index.
+ * All written registers are committed to EEPROM at once.
+ */
+static eMBErrorCode CalibrationCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  auto& calibration = Analog::input.GetCalibration();
+  auto channels = calibration.GetChannels();
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    auto& ch = channels[index / R_CalibrationRegsPerChannel];
+    size_t field = index % R_CalibrationRegsPerChannel;
+    if(eMode == MB_REG_READ) {
+      const uint16_t regs[R_CalibrationRegsPerChannel] = {uint16_t(ch.gain), uint16_t(ch.offset), ch.curve};
+      *regBuffer16 = htons(regs[field]);
+    }
+    else {
+      uint16_t val = ntohs(*regBuffer16);
+      if(field == 0) {
+        ch.gain = int16_t(val);
+      }
+      else if(field == 1) {
+        ch.offset = int16_t(val);
+      }
+      else {
+        //out of range index is rejected by the validation
+        ch.curve = uint8_t(val > 0xFF ? 0xFF : val);
+      }
+    }
+    ++regBuffer16;
+  }
+  if(eMode == MB_REG_WRITE && calibration.SetChannels(channels) != Rtos::Status::Success) {
+    return MB_EINVAL;
+  }
+  return MB_ENOERR;
+}
+
+/**
+ * Binary conversion of analog inputs, 2 registers per channel: threshold, hysteresis
+ */
+static eMBErrorCode ThresholdCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  auto& thresholds = Analog::input.GetThresholds();
+  auto config = thresholds.Get();
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    auto& cfg = config[index / R_ThresholdRegsPerChannel];
+    auto& val = (index & 0x01) ? cfg.hysteresis : cfg.threshold;
+    if(eMode == MB_REG_READ) {
+      *regBuffer16++ = htons(val);
+    }
+    else {
+      val = ntohs(*regBuffer16++);
+    }
+  }
+  if(eMode == MB_REG_WRITE && thresholds.Set(config) != Rtos::Status::Success) {
+    return MB_EINVAL;
+  }
+  return MB_ENOERR;
+}
+
+#if BOARD_VER == 1
+/**
+ * Native digital inputs counting mode: interrupt driven channels mask,
+ * minimal pulse width in us per channel, hardware counted channel mask,
+ * timer input mode (0 - counter, 1 - capture, 2 - encoder), capture averaging,
+ * debounce depth in samples per channel, debounce depth of the expansion chain inputs
+ */
+static eMBErrorCode DigitalInputCfgCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  auto config = Digital::input.GetConfig();
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    static constexpr size_t N = Digital::NATIVE_CH_NUMBER;
+    auto& val = !index ? config.interruptMask
+              : index <= N ? config.minPulseWidth[index - 1]
+              : index == N + 1 ? config.hwCounterMask
+              : index == N + 2 ? config.timerInputMode
+              : index == N + 3 ? config.captureAveraging
+              : index <= N * 2 + 3 ? config.debounce[index - (N + 4)]
+              : config.expansionDebounce;
+    if(eMode == MB_REG_READ) {
+      *regBuffer16++ = htons(val);
+    }
+    else {
+      val = ntohs(*regBuffer16++);
+    }
+  }
+  if(eMode == MB_REG_WRITE && Digital::input.SetConfig(config) != Rtos::Status::Success) {
+    return MB_EINVAL;
+  }
+  return MB_ENOERR;
+}
+
+/**
+ * Timer input capture: frequency (mHz, 32 bit), duty cycle (0.01%),
+ * averaged period and pulse width (timer ticks, 32 bit)
+ */
+static void CaptureCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs)
+{
+  auto m = Digital::timerInput.GetMeasurement();
+  std::array<uint16_t, R_CaptureSize> regs;
+  uint16_t* p = regs.data();
+  Put32(p, m.frequency);
+  *p++ = htons(m.duty);
+  Put32(p, m.period);
+  Put32(p, m.width);
+  std::copy_n(&regs[index], usNRegs, regBuffer16);
+}
+
+/**
+ * Digital input sampling diagnostics: fifo overruns (32 bit), max fifo depth
+ */
+static void InputDiagCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs)
+{
+  auto stat = Digital::input.GetFifoStat();
+  std::array<uint16_t, R_InputDiagSize> regs;
+  uint16_t* p = regs.data();
+  Put32(p, stat.overruns);
+  *p++ = htons(uint16_t(stat.maxDepth));
+  std::copy_n(&regs[index], usNRegs, regBuffer16);
+}
+
+/**
+ * Quadrature encoder: position (counts, 32 bit signed), velocity (counts/s, 32 bit signed)
+ */
+static void EncoderCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs)
+{
+  auto encoder = Digital::timerInput.GetEncoder();
+  std::array<uint16_t, R_EncoderSize> regs;
+  uint16_t* p = regs.data();
+  Put32(p, uint32_t(encoder.position));
+  Put32(p, uint32_t(encoder.velocity));
+  std::copy_n(&regs[index], usNRegs, regBuffer16);
+}
+
+/**
+ * Expansion chain inputs, 16 per register, the first input is the least significant bit of the first register
+ */
+static void ExpansionInputCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs)
+{
+  uint32_t val = Digital::input.GetExpansionVal();
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    *regBuffer16++ = htons(uint16_t(val >> (index * 16)));
+  }
+}
+
+/**
+ * Expansion chain input counters, 32 bit, the word order of the counters block
+ */
+static void ExpansionCounterCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs)
+{
+  auto counters = Digital::input.GetExpansionCounters();
+  std::array<uint16_t, R_ExpansionCounterSize> regs;
+  uint16_t* p = regs.data();
+  for(auto c : counters) {
+    Put32(p, c);
+  }
+  std::copy_n(&regs[index], usNRegs, regBuffer16);
+}
+
+/**
+ * Whole output chain, a register per 16 outputs, the first one mirrors the digital output register.
+ * Written registers are latched at once.
+ */
+static eMBErrorCode OutputChainCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    Digital::OutputCommand cmd{};
+    if(eMode == MB_REG_WRITE) {
+      cmd.Set(decltype(cmd)::Mode::Write, ntohs(*regBuffer16++));
+    }
+    cmd.SetWord(index, eMode == MB_REG_READ || usNRegs > 1);
+    Digital::output.SendMessage(cmd);
+    if(eMode == MB_REG_READ) {
+      *regBuffer16++ = htons(uint16_t(cmd.GetValue()));
+    }
+  }
+  return MB_ENOERR;
+}
+
+/**
+ * Analog output ramp rates, 1/256 of a count per PWM period, 0 - no ramp.
+ */
+static eMBErrorCode AnalogRampCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  auto ramps = Analog::output.GetRamps();
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    if(eMode == MB_REG_READ) {
+      *regBuffer16++ = htons(ramps[index]);
+    }
+    else {
+      ramps[index] = ntohs(*regBuffer16++);
+    }
+  }
+  if(eMode == MB_REG_WRITE && Analog::output.SetRamps(ramps) != Rtos::Status::Success) {
+    return MB_EINVAL;
+  }
+  return MB_ENOERR;
+}
+
+//Analog outputs in 1/16 counts, the fraction is dithered on the channels of the mask
+static eMBErrorCode AnalogFineCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  Analog::Output::targets_t values{};
+  uint16_t mask{};
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    if(eMode == MB_REG_READ) {
+      *regBuffer16++ = htons(Analog::output.GetFineValue(index));
+    }
+    else {
+      values[index] = ntohs(*regBuffer16++);
+      mask |= uint16_t(1U << index);
+    }
+  }
+  //The written channels are updated in the same PWM period
+  if(mask) {
+    Analog::output.SetFineValues(mask, values);
+  }
+  return MB_ENOERR;
+}
+
+static eMBErrorCode DitherMaskCB(uint16_t* regBuffer16, eMBRegisterMode eMode)
+{
+  if(eMode == MB_REG_READ) {
+    *regBuffer16 = htons(Analog::output.GetDitherMask());
+  }
+  else if(Analog::output.SetDitherMask(ntohs(*regBuffer16)) != Rtos::Status::Success) {
+    return MB_EINVAL;
+  }
+  return MB_ENOERR;
+}
+
+/**
+ * Synchronized analog output update: hold (1 - the output writes are staged), commit (write 1 to apply
+ * the staged values at once, reads the mask of the staged channels). The commit may be broadcast.
+ */
+static eMBErrorCode AnalogSyncCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  enum { Hold, Commit };
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    if(eMode == MB_REG_READ) {
+      *regBuffer16++ = htons(index == Hold ? uint16_t(Analog::output.GetHold()) : Analog::output.GetStagedMask());
+      continue;
+    }
+    auto val = ntohs(*regBuffer16++);
+    if(val > 1) {
+      return MB_EINVAL;
+    }
+    if(index == Hold) {
+      Analog::output.SetHold(val);
+    }
+    else if(val) {
+      Analog::output.Commit();
+    }
+  }
+  return MB_ENOERR;
+}
+
+/**
+ * Waveform playback: channel, length, divider (PWM periods per sample), repeat count (0 - continuous),
+ * run (1 - start from the first sample, 0 - stop). The settings are applied on the next start.
+ */
+static eMBErrorCode WaveCtrlCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  enum { Channel, Length, Divider, Repeat, Run };
+  auto settings = Analog::output.GetWaveSettings();
+  uint16_t* const fields[Run] = { &settings.channel, &settings.length, &settings.divider, &settings.repeat };
+  bool changed{}, run{}, stop{};
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    if(eMode == MB_REG_READ) {
+      *regBuffer16++ = htons(index == Run ? uint16_t(Analog::output.IsWavePlaying()) : *fields[index]);
+    }
+    else if(index == Run) {
+      auto val = ntohs(*regBuffer16++);
+      if(val > 1) {
+        return MB_EINVAL;
+      }
+      run = val;
+      stop = !val;
+    }
+    else {
+      *fields[index] = ntohs(*regBuffer16++);
+      changed = true;
+    }
+  }
+  if(changed && Analog::output.SetWaveSettings(settings) != Rtos::Status::Success) {
+    return MB_EINVAL;
+  }
+  if(run) {
+    Analog::output.StartWave();
+  }
+  else if(stop) {
+    Analog::output.StopWave();
+  }
+  return MB_ENOERR;
+}
+
+//Waveform samples, may be rewritten during the playback
+static eMBErrorCode WaveTableCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    if(eMode == MB_REG_READ) {
+      *regBuffer16++ = htons(Analog::output.GetWavePoint(index));
+    }
+    else if(Analog::output.SetWavePoint(index, ntohs(*regBuffer16++)) != Rtos::Status::Success) {
+      return MB_EINVAL;
+    }
+  }
+  return MB_ENOERR;
+}
+
+/**
+ * PID loops: the common period in ms, then per loop: enable, channels (input | output << 8), setpoint,
+ * Kp, Ki (1/s), Kd (s) in Q8.8, output min, output max, anti-windup mode, present output (read only).
+ * A write of the setpoints alone isn't stored in EEPROM.
+ */
+static eMBErrorCode PidCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  auto config = Analog::pidControl.GetConfig();
+  bool persist{};
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    if(!index) {
+      if(eMode == MB_REG_READ) {
+        *regBuffer16++ = htons(config.periodMs);
+      }
+      else {
+        config.periodMs = ntohs(*regBuffer16++);
+        persist = true;
+      }
+      continue;
+    }
+    size_t loop = (index - 1) / R_PidRegsPerLoop, field = (index - 1) % R_PidRegsPerLoop;
+    if(field == R_PidRegsPerLoop - 1) {
+      if(eMode == MB_REG_WRITE) {
+        return MB_EINVAL;
+      }
+      *regBuffer16++ = htons(Analog::pidControl.GetOutput(loop));
+      continue;
+    }
+    auto& l = config.loops[loop];
+    uint16_t* const fields[R_PidRegsPerLoop - 1] = {
+      &l.enable, &l.channels, &l.setpoint, (uint16_t*)&l.kp, (uint16_t*)&l.ki, (uint16_t*)&l.kd,
+      &l.outMin, &l.outMax, &l.antiWindup
+    };
+    auto& val = *fields[field];
+    if(eMode == MB_REG_READ) {
+      *regBuffer16++ = htons(val);
+    }
+    else {
+      val = ntohs(*regBuffer16++);
+      persist = persist || field != 2;
+    }
+  }
+  if(eMode == MB_REG_WRITE && Analog::pidControl.SetConfig(config, persist) != Rtos::Status::Success) {
+    return MB_EINVAL;
+  }
+  return MB_ENOERR;
+}
+#endif
+
+#if BOARD_VER == 2
+/**
+ * Software PWM: mask of the PWM driven outputs, then the duty per output in SoftPwm::resolution steps.
+ * The duties are applied before the mask, so one write can set them up and start the outputs.
+ */
+static eMBErrorCode SoftPwmCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  using Digital::softPwm;
+  std::array<uint16_t, R_SoftPwmSize> regs;
+  regs[0] = uint16_t(softPwm.GetMask());
+  for(size_t ch{}; ch < Digital::SoftPwm::numChannels; ++ch) {
+    regs[ch + 1] = softPwm.GetDuty(ch);
+  }
+  if(eMode == MB_REG_READ) {
+    for(; usNRegs > 0; --usNRegs, ++index) {
+      *regBuffer16++ = htons(regs[index]);
+    }
+    return MB_ENOERR;
+  }
+  for(size_t i = index; i < index + usNRegs; ++i) {
+    regs[i] = ntohs(*regBuffer16++);
+    if(regs[i] > (i ? Digital::SoftPwm::resolution : Utils::NumberToMask_v<Digital::SoftPwm::numChannels>)) {
+      return MB_EINVAL;
+    }
+  }
+  for(size_t ch{}; ch < Digital::SoftPwm::numChannels; ++ch) {
+    softPwm.SetDuty(ch, regs[ch + 1]);
+  }
+  softPwm.SetMask(regs[0]);
+  return MB_ENOERR;
+}
+#endif
+
+/**
+ * Output schedule control: command/state (write 1 - start, 0 - stop, reads 1 while playing),
+ * number of entries, index of the next entry (read only).
+ * Written as a broadcast the start command arms all the listening devices at once.
+ */
+static eMBErrorCode ScheduleCtrlCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  using Digital::schedule;
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    if(eMode == MB_REG_READ) {
+      const uint16_t regs[R_ScheduleCtrlSize] = {schedule.IsRunning(), uint16_t(schedule.GetLength()),
+                                                 uint16_t(schedule.GetPosition())};
+      *regBuffer16++ = htons(regs[index]);
+      continue;
+    }
+    uint16_t val = ntohs(*regBuffer16++);
+    Rtos::Status status = Rtos::Status::Failure;
+    if(index == 0 && val <= 1) {
+      if(val) {
+        status = schedule.Start();
+      }
+      else {
+        schedule.Stop();
+        status = Rtos::Status::Success;
+      }
+    }
+    else if(index == 1) {
+      status = schedule.SetLength(val);
+    }
+    if(status != Rtos::Status::Success) {
+      return MB_EINVAL;
+    }
+  }
+  return MB_ENOERR;
+}
+
+/**
+ * Output schedule entries, 4 registers each: offset from the start in us (32 bit), command mode, value.
+ * Modes are the output command ones: 0 - set, 1 - clear, 3 - write, 4 - toggle.
+ */
+static eMBErrorCode ScheduleCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  using Digital::schedule;
+  size_t first = index / R_ScheduleRegsPerEntry;
+  size_t last = (index + usNRegs - 1) / R_ScheduleRegsPerEntry;
+  std::array<uint16_t, R_ScheduleSize> regs;
+  for(size_t i = first; i <= last; ++i) {
+    auto entry = schedule.GetEntry(i);
+    uint16_t* p = &regs[i * R_ScheduleRegsPerEntry];
+    Put32(p, entry.offset);
+    *p++ = htons(uint16_t(entry.mode));
+    *p = htons(entry.value);
+  }
+  if(eMode == MB_REG_READ) {
+    std::copy_n(&regs[index], usNRegs, regBuffer16);
+    return MB_ENOERR;
+  }
+  std::copy_n(regBuffer16, usNRegs, &regs[index]);
+  for(size_t i = first; i <= last; ++i) {
+    const uint16_t* p = &regs[i * R_ScheduleRegsPerEntry];
+    Digital::Schedule::Entry entry{Get32(p), ntohs(p[3]),
+                                   Digital::OutputCommand::Mode(ntohs(p[2]))};
+    if(schedule.SetEntry(i, entry) != Rtos::Status::Success) {
+      return MB_EINVAL;
+    }
+  }
+  return MB_ENOERR;
+}
+
+/**
+ * Logic program upload buffer, loaded by the command of the control block.
+ * Reads back the running program until written.
+ */
+static Digital::LogicEngine::program_t& LogicStaging()
+{
+  static Digital::LogicEngine::program_t staging = Digital::logicEngine.GetProgram();
+  return staging;
+}
+
+/**
+ * Logic control: command/state (write 0 - stop, 1 - run, 2 - verify, store and run the uploaded program,
+ * reads 1 while running), worst scan time in us (write 0 to reset).
+ */
+static eMBErrorCode LogicCtrlCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  using Digital::logicEngine;
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    if(eMode == MB_REG_READ) {
+      const uint16_t regs[R_LogicCtrlSize] = {logicEngine.IsRunning(),
+                                              uint16_t(logicEngine.GetMaxScanCycles() / (STM32_SYSCLK / 1000000UL))};
+      *regBuffer16++ = htons(regs[index]);
+      continue;
+    }
+    uint16_t val = ntohs(*regBuffer16++);
+    if(index == 0 && val < 2) {
+      logicEngine.Run(val);
+    }
+    else if(index == 0 && val == 2) {
+      if(!Digital::LogicEngine::Verify(LogicStaging())) {
+        return MB_EINVAL;
+      }
+      if(logicEngine.Load(LogicStaging()) != Rtos::Status::Success) {
+        return MB_EIO;
+      }
+    }
+    else if(index == 1 && val == 0) {
+      logicEngine.ResetMaxScanCycles();
+    }
+    else {
+      return MB_EINVAL;
+    }
+  }
+  return MB_ENOERR;
+}
+
+static void LogicProgramCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  auto& staging = LogicStaging();
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    if(eMode == MB_REG_READ) {
+      *regBuffer16++ = htons(staging[index]);
+    }
+    else {
+      staging[index] = ntohs(*regBuffer16++);
+    }
+  }
+}
+
+/**
+ * Counter pulse rates in mHz (32 bit), same channel order as the counters
+ */
+static void RateCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs)
+{
+  auto rates = Digital::rateMeter.GetRates();
+  std::array<uint16_t, R_RateSize> regs;
+  uint16_t* p = regs.data();
+  for(auto rate : rates) {
+    Put32(p, rate);
+  }
+  std::copy_n(&regs[index], usNRegs, regBuffer16);
+}
+
+/**
+ * 64-bit counters, the high word first
+ */
+static void Counter64CB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, const Digital::CounterBank::counters_t& counters)
+{
+  std::array<uint16_t, R_Counter64Size> regs;
+  uint16_t* p = regs.data();
+  for(auto counter : counters) {
+    Put32(p, uint32_t(counter >> 32));
+    Put32(p, uint32_t(counter));
+  }
+  std::copy_n(&regs[index], usNRegs, regBuffer16);
+}
+
+/**
+ * Counters command: 1 - latch all counters into the snapshot block, 2 - latch and reset them.
+ * Reads as 0.
+ */
+static eMBErrorCode CounterCmdCB(uint16_t* regBuffer16, eMBRegisterMode eMode)
+{
+  if(eMode == MB_REG_READ) {
+    *regBuffer16 = 0;
+    return MB_ENOERR;
+  }
+  auto cmd = Digital::CounterBank::Command(ntohs(*regBuffer16));
+  if(Digital::counterBank.Execute(cmd) != Rtos::Status::Success) {
+    return MB_EINVAL;
+  }
+  return MB_ENOERR;
+}
+
+/**
+ * Output pulse: channel, width, period, count, time unit (0 - us, 1 - ms).
+ * Any write starts the train with the resulting parameters, the registers keep the last ones.
+ */
+static eMBErrorCode PulseCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  static std::array<uint16_t, R_PulseSize> regs{0, htons(1), 0, htons(1), 0};
+  if(eMode == MB_REG_READ) {
+    std::copy_n(&regs[index], usNRegs, regBuffer16);
+    return MB_ENOERR;
+  }
+  auto newRegs = regs;
+  std::copy_n(regBuffer16, usNRegs, &newRegs[index]);
+  uint16_t unit = ntohs(newRegs[4]);
+  if(unit > 1) {
+    return MB_EINVAL;
+  }
+  uint32_t scale = unit ? 1000 : 1;
+  Digital::PulseTimer::Pulse pulse{ntohs(newRegs[0]), ntohs(newRegs[1]) * scale,
+                                   ntohs(newRegs[2]) * scale, ntohs(newRegs[3])};
+  if(Digital::pulseTimer.Start(pulse) != Rtos::Status::Success) {
+    return MB_EINVAL;
+  }
+  regs = newRegs;
+  return MB_ENOERR;
+}
+
+/**
+ * Rate averaging windows per counter, in RateMeter::periodMs units
+ */
+static eMBErrorCode RateWindowCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  auto windows = Digital::rateMeter.GetWindows();
+  for(; usNRegs > 0; --usNRegs, ++index) {
+    if(eMode == MB_REG_READ) {
+      *regBuffer16++ = htons(windows[index]);
+    }
+    else {
+      windows[index] = ntohs(*regBuffer16++);
+    }
+  }
+  if(eMode == MB_REG_WRITE && Digital::rateMeter.SetWindows(windows) != Rtos::Status::Success) {
+    return MB_EINVAL;
+  }
+  return MB_ENOERR;
+}
+
+/**
+ * Linearization tables, 32 registers per curve: x0, y0, x1, y1...
+ * Unused points have x == 0x7FFF, each written curve must stay valid as a whole.
+ */
+static eMBErrorCode CurveCB(uint16_t* regBuffer16, size_t index, USHORT usNRegs, eMBRegisterMode eMode)
+{
+  auto& calibration = Analog::input.GetCalibration();
+  while(usNRegs > 0) {
+    size_t curveIndex = index / R_CurveRegsPerCurve + 1;
+    auto points = calibration.GetCurve(curveIndex);
+    for(; usNRegs > 0 && index / R_CurveRegsPerCurve + 1 == curveIndex; --usNRegs, ++index) {
+      auto& point = points[(index % R_CurveRegsPerCurve) / 2];
+      auto& val = (index & 0x01) ? point.y : point.x;
+      if(eMode == MB_REG_READ) {
+        *regBuffer16++ = htons(uint16_t(val));
+      }
+      else {
+        val = int16_t(ntohs(*regBuffer16++));
+      }
+    }
+    if(eMode == MB_REG_WRITE && calibration.SetCurve(curveIndex, points) != Rtos::Status::Success) {
+      return MB_EINVAL;
+    }
+  }
+  return MB_ENOERR;
+}
+
+static constexpr UCHAR MB_FUNC_READ_FIFO_QUEUE = 24;
+
+static inline void PutBE16(UCHAR*& frame, uint16_t val)
+{
+  *frame++ = UCHAR(val >> 8);
+  *frame++ = UCHAR(val & 0xFF);
+}
+
+/**
+ * Edge event log (FC24). The FIFO pointer address of the request acknowledges the events
+ * before that sequence number. The first FIFO register of the response is the sequence number
+ * of the first returned event, each event follows as 2 registers (see EventLog::Event::Pack()).
+ */
+static eMBException ReadEventFifoCB(UCHAR* pucFrame, USHORT* usLen)
+{
+  //FIFO count is limited to 31 registers
+  static constexpr size_t maxEvents = 15;
+  if(*usLen != MB_PDU_DATA_OFF + 2) {
+    return MB_EX_ILLEGAL_DATA_VALUE;
+  }
+  uint16_t ack = uint16_t(pucFrame[MB_PDU_DATA_OFF] << 8 | pucFrame[MB_PDU_DATA_OFF + 1]);
+  std::array<Digital::EventLog::Event, maxEvents> events;
+  uint16_t firstSeq;
+  size_t count = Digital::eventLog.Read(ack, events.data(), events.size(), firstSeq);
+  uint16_t fifoCount = uint16_t(1 + count * 2);
+  UCHAR* frame = &pucFrame[MB_PDU_DATA_OFF];
+  PutBE16(frame, uint16_t(2 + fifoCount * 2));
+  PutBE16(frame, fifoCount);
+  PutBE16(frame, firstSeq);
+  for(size_t i{}; i < count; ++i) {
+    uint32_t packed = events[i].Pack();
+    PutBE16(frame, uint16_t(packed >> 16));
+    PutBE16(frame, uint16_t(packed & 0xFFFF));
+  }
+  *usLen = USHORT(frame - pucFrame);
+  return MB_EX_NONE;
+}
+
 extern "C" {
 
   /**
@@ -94,13 +860,97 @@ extern "C" {
         eStatus = MB_ENOREG;
       }
     }
+    //Counters snapshot taken by the latch command
+    else if(usAddress >= R_LatchedStart) {
+      iRegIndex = (int)(usAddress - R_LatchedStart);
+      if((usNRegs + iRegIndex) <= R_LatchedSize) {
+        Counter64CB(regBuffer16, (size_t)iRegIndex, usNRegs, Digital::counterBank.GetLatched());
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    //64-bit counters
+    else if(usAddress >= R_Counter64Start) {
+      iRegIndex = (int)(usAddress - R_Counter64Start);
+      if((usNRegs + iRegIndex) <= R_Counter64Size) {
+        Counter64CB(regBuffer16, (size_t)iRegIndex, usNRegs, Digital::counterBank.Get());
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+#if BOARD_VER == 1
+    //Quadrature encoder data
+    else if(usAddress >= R_EncoderStart) {
+      iRegIndex = (int)(usAddress - R_EncoderStart);
+      if((usNRegs + iRegIndex) <= R_EncoderSize) {
+        EncoderCB(regBuffer16, (size_t)iRegIndex, usNRegs);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    //Timer input capture data
+    else if(usAddress >= R_CaptureStart) {
+      iRegIndex = (int)(usAddress - R_CaptureStart);
+      if((usNRegs + iRegIndex) <= R_CaptureSize) {
+        CaptureCB(regBuffer16, (size_t)iRegIndex, usNRegs);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    //Digital input sampling diagnostics
+    else if(usAddress >= R_InputDiagStart) {
+      iRegIndex = (int)(usAddress - R_InputDiagStart);
+      if((usNRegs + iRegIndex) <= R_InputDiagSize) {
+        InputDiagCB(regBuffer16, (size_t)iRegIndex, usNRegs);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    //Expansion chain input counters
+    else if(usAddress >= R_ExpansionCounterStart) {
+      iRegIndex = (int)(usAddress - R_ExpansionCounterStart);
+      if((usNRegs + iRegIndex) <= R_ExpansionCounterSize) {
+        ExpansionCounterCB(regBuffer16, (size_t)iRegIndex, usNRegs);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+#endif
+    //Counter rates
+    else if(usAddress >= R_RateStart) {
+      iRegIndex = (int)(usAddress - R_RateStart);
+      if((usNRegs + iRegIndex) <= R_RateSize) {
+        RateCB(regBuffer16, (size_t)iRegIndex, usNRegs);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+#if BOARD_VER == 1
+    //Expansion chain inputs
+    else if(usAddress >= R_ExpansionInputStart) {
+      iRegIndex = (int)(usAddress - R_ExpansionInputStart);
+      if((usNRegs + iRegIndex) <= R_ExpansionInputSize) {
+        ExpansionInputCB(regBuffer16, (size_t)iRegIndex, usNRegs);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+#endif
     //Counters data, the number of registers must be even
     else if(usAddress >= R_CounterStart) {
       iRegIndex = (int)(usAddress - R_CounterStart);
       if((usNRegs + iRegIndex) <= R_CounterSize && (usNRegs & 0x01) == 0) {
-        auto counters = Digital::input.GetCounters();
+        auto counters = Digital::counterBank.Get();
         while(usNRegs > 0) {
-          uint32_t be32 = htonl(counters[(size_t)iRegIndex]);
+          uint32_t be32 = htonl(uint32_t(counters[(size_t)iRegIndex]));
           *regBuffer16++ = uint16_t(be32 & 0xFFFF);
           *regBuffer16++ = uint16_t(be32 >> 16);
           ++iRegIndex;
@@ -111,6 +961,21 @@ extern "C" {
         eStatus = MB_ENOREG;
       }
     }
+    //Analog inputs in engineering units
+    else if(usAddress >= R_AnalogEngStart) {
+      iRegIndex = (int)(usAddress - R_AnalogEngStart);
+      if((usNRegs + iRegIndex) <= R_AnalogEngSize) {
+        auto inputs = Analog::input.GetEngSamples();
+        while(usNRegs > 0) {
+          *regBuffer16++ = htons(uint16_t(inputs[(size_t)iRegIndex]));
+          ++iRegIndex;
+          --usNRegs;
+        }
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
     //Analog inputs data
     else if(usAddress >= R_AnalogInputStart) {
       iRegIndex = (int)(usAddress - R_AnalogInputStart);
@@ -156,12 +1021,171 @@ extern "C" {
     uint16_t* regBuffer16 = (uint16_t*)pucRegBuffer;
     /* it already plus one in modbus function method. */
     --usAddress;
-    //Digital output data, write only part (set/clear/toggle)
-    if(eMode == MB_REG_READ &&
-       (usAddress > R_DigitalOutputStart || (usAddress == R_DigitalOutputStart && usNRegs > 1))) {
-      return MB_ENOREG;
+#if BOARD_VER == 1
+    if(usAddress >= R_WaveTableStart) {
+      iRegIndex = (int)(usAddress - R_WaveTableStart);
+      if((usNRegs + iRegIndex) <= R_WaveTableSize) {
+        eStatus = WaveTableCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    else if(usAddress >= R_WaveCtrlStart) {
+      iRegIndex = (int)(usAddress - R_WaveCtrlStart);
+      if((usNRegs + iRegIndex) <= R_WaveCtrlSize) {
+        eStatus = WaveCtrlCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    else if(usAddress >= R_AnalogRampStart) {
+      iRegIndex = (int)(usAddress - R_AnalogRampStart);
+      if((usNRegs + iRegIndex) <= R_AnalogRampSize) {
+        eStatus = AnalogRampCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
     }
-    if(usAddress >= R_DigitalOutputStart) {
+    else if(usAddress >= R_PidStart) {
+      iRegIndex = (int)(usAddress - R_PidStart);
+      if((usNRegs + iRegIndex) <= R_PidSize) {
+        eStatus = PidCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    else
+#endif
+    if(usAddress >= R_LogicProgramStart) {
+      iRegIndex = (int)(usAddress - R_LogicProgramStart);
+      if((usNRegs + iRegIndex) <= R_LogicProgramSize) {
+        LogicProgramCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    else if(usAddress >= R_LogicCtrlStart) {
+      iRegIndex = (int)(usAddress - R_LogicCtrlStart);
+      if((usNRegs + iRegIndex) <= R_LogicCtrlSize) {
+        eStatus = LogicCtrlCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    else if(usAddress >= R_ScheduleStart) {
+      iRegIndex = (int)(usAddress - R_ScheduleStart);
+      if((usNRegs + iRegIndex) <= R_ScheduleSize) {
+        eStatus = ScheduleCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    else if(usAddress >= R_ScheduleCtrlStart) {
+      iRegIndex = (int)(usAddress - R_ScheduleCtrlStart);
+      if((usNRegs + iRegIndex) <= R_ScheduleCtrlSize) {
+        eStatus = ScheduleCtrlCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+#if BOARD_VER == 1
+    else if(usAddress >= R_OutputChainStart) {
+      iRegIndex = (int)(usAddress - R_OutputChainStart);
+      if((usNRegs + iRegIndex) <= R_OutputChainSize) {
+        eStatus = OutputChainCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+#endif
+    else if(usAddress >= R_CurveStart) {
+      iRegIndex = (int)(usAddress - R_CurveStart);
+      if((usNRegs + iRegIndex) <= R_CurveSize) {
+        eStatus = CurveCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    else if(usAddress >= R_CalibrationStart) {
+      iRegIndex = (int)(usAddress - R_CalibrationStart);
+      if((usNRegs + iRegIndex) <= R_CalibrationSize) {
+        eStatus = CalibrationCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    else if(usAddress >= R_CounterCmdStart) {
+      if(usAddress == R_CounterCmdStart && usNRegs == R_CounterCmdSize) {
+        eStatus = CounterCmdCB(regBuffer16, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    else if(usAddress >= R_RateWindowStart) {
+      iRegIndex = (int)(usAddress - R_RateWindowStart);
+      if((usNRegs + iRegIndex) <= R_RateWindowSize) {
+        eStatus = RateWindowCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    else if(usAddress >= R_ThresholdStart) {
+      iRegIndex = (int)(usAddress - R_ThresholdStart);
+      if((usNRegs + iRegIndex) <= R_ThresholdSize) {
+        eStatus = ThresholdCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+#if BOARD_VER == 1
+    else if(usAddress >= R_DigitalInputCfgStart) {
+      iRegIndex = (int)(usAddress - R_DigitalInputCfgStart);
+      if((usNRegs + iRegIndex) <= R_DigitalInputCfgSize) {
+        eStatus = DigitalInputCfgCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+#else
+    else if(usAddress >= R_SoftPwmStart) {
+      iRegIndex = (int)(usAddress - R_SoftPwmStart);
+      if((usNRegs + iRegIndex) <= R_SoftPwmSize) {
+        eStatus = SoftPwmCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+#endif
+    else if(usAddress >= R_PulseStart) {
+      iRegIndex = (int)(usAddress - R_PulseStart);
+      if((usNRegs + iRegIndex) <= R_PulseSize) {
+        eStatus = PulseCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    else if(usAddress >= R_DigitalOutputStart) {
+      //Digital output data, write only part (set/clear/toggle)
+      if(eMode == MB_REG_READ && (usAddress > R_DigitalOutputStart || usNRegs > 1)) {
+        return MB_ENOREG;
+      }
       iRegIndex = (int)(usAddress - R_DigitalOutputStart);
       if((usNRegs + iRegIndex) <= R_DigitalOutputSize) {
         while(usNRegs > 0) {
@@ -212,6 +1236,33 @@ extern "C" {
       }
     }
 #if BOARD_VER == 1
+    else if(usAddress >= R_AnalogSyncStart) {
+      iRegIndex = (int)(usAddress - R_AnalogSyncStart);
+      if((usNRegs + iRegIndex) <= R_AnalogSyncSize) {
+        eStatus = AnalogSyncCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    else if(usAddress >= R_DitherMaskStart) {
+      iRegIndex = (int)(usAddress - R_DitherMaskStart);
+      if((usNRegs + iRegIndex) <= R_DitherMaskSize) {
+        eStatus = DitherMaskCB(regBuffer16, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
+    else if(usAddress >= R_AnalogFineStart) {
+      iRegIndex = (int)(usAddress - R_AnalogFineStart);
+      if((usNRegs + iRegIndex) <= R_AnalogFineSize) {
+        eStatus = AnalogFineCB(regBuffer16, (size_t)iRegIndex, usNRegs, eMode);
+      }
+      else {
+        eStatus = MB_ENOREG;
+      }
+    }
     else if(usAddress >= R_AnalogOutputStart) {
       iRegIndex = (int)(usAddress - R_AnalogOutputStart);
       if((usNRegs + iRegIndex) <= R_AnalogOutputSize) {
@@ -263,6 +1314,11 @@ bool Modbus::InitModbus()
     return FALSE;
   }
 
+  eStatus = eMBRegisterCB(MB_FUNC_READ_FIFO_QUEUE, ReadEventFifoCB);
+  if (eStatus != MB_ENOERR) {
+    return FALSE;
+  }
+
   eStatus = eMBEnable();
   if (eStatus != MB_ENOERR) {
     return FALSE;
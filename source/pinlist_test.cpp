@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host test of the port grouped pin lists, not a part of the firmware build:
+ *   g++ -std=gnu++17 -Isource/host -Iutils -Idrivers -o pinlist_test source/pinlist_test.cpp && ./pinlist_test
+ * Pins are on mock ports that count the register accesses, the result of each list operation
+ * is compared with the same operation done pin by pin.
+ */
+
+#include "pinlist.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using namespace Mcudrv;
+
+namespace {
+
+  template<uint8_t ID>
+  struct MockPort {
+    enum { id = ID };
+    static inline uint16_t idr, odr;
+    static inline size_t reads, writes;
+    static uint16_t Read()
+    {
+      ++reads;
+      return idr;
+    }
+    static uint16_t ReadODR()
+    {
+      ++reads;
+      return odr;
+    }
+    static void ClearAndSet(uint16_t clearmask, uint16_t setmask)
+    {
+      ++writes;
+      odr = uint16_t((odr & ~clearmask) | setmask);
+    }
+  };
+
+  template<typename Port_, uint8_t pos>
+  struct MockPin {
+    using Port = Port_;
+    enum {
+      mask = 1U << pos,
+      position = pos,
+      port_id = Port::id
+    };
+    static constexpr bool inverted = false;
+    static bool IsSet()
+    {
+      return Port::idr & mask;
+    }
+    static bool IsODRSet()
+    {
+      return Port::odr & mask;
+    }
+  };
+
+  using PortA = MockPort<0>;
+  using PortB = MockPort<1>;
+  using PortC = MockPort<2>;
+
+  size_t failures;
+
+  void Check(bool cond, const char* what, unsigned a = 0, unsigned b = 0)
+  {
+    if(!cond) {
+      if(failures < 20) {
+        std::printf("FAIL: %s (%x, %x)\n", what, a, b);
+      }
+      ++failures;
+    }
+  }
+
+  void ResetCounts()
+  {
+    PortA::reads = PortA::writes = PortB::reads = PortB::writes = PortC::reads = PortC::writes = 0;
+  }
+
+  size_t Reads()
+  {
+    return PortA::reads + PortB::reads + PortC::reads;
+  }
+
+  size_t Writes()
+  {
+    return PortA::writes + PortB::writes + PortC::writes;
+  }
+
+  template<typename... Pins>
+  uint32_t ReadPerPin()
+  {
+    uint32_t val{}, i{};
+    ((val |= uint32_t(Pins::IsSet()) << i++), ...);
+    return val;
+  }
+
+  template<typename... Pins>
+  uint32_t OdrPerPin()
+  {
+    uint32_t val{}, i{};
+    ((val |= uint32_t(Pins::IsODRSet()) << i++), ...);
+    return val;
+  }
+
+  //Pins of the other bits of the ports are left alone
+  template<size_t numPorts, typename... Pins>
+  void TestList(std::mt19937& rng, const char* name)
+  {
+    using List = Pinlist<Pins...>;
+    constexpr uint32_t valueMask = (1UL << sizeof...(Pins)) - 1;
+    for(size_t round{}; round < 10000; ++round) {
+      PortA::idr = uint16_t(rng());
+      PortB::idr = uint16_t(rng());
+      PortC::idr = uint16_t(rng());
+      ResetCounts();
+      uint32_t val = List::Read();
+      Check(val == ReadPerPin<Pins...>(), name, val, ReadPerPin<Pins...>());
+      Check(Reads() == numPorts, "one read per port", unsigned(Reads()));
+
+      PortA::odr = uint16_t(rng());
+      PortB::odr = uint16_t(rng());
+      PortC::odr = uint16_t(rng());
+      const uint16_t odrA = PortA::odr, odrB = PortB::odr, odrC = PortC::odr;
+      uint32_t value = rng() & valueMask;
+      ResetCounts();
+      List::Write(value);
+      Check(Writes() == numPorts, "one write per port", unsigned(Writes()));
+      Check(OdrPerPin<Pins...>() == value, name, OdrPerPin<Pins...>(), value);
+      Check(List::ReadODR() == value, "output register readback", List::ReadODR(), value);
+      //Bits of the ports that are not in the list
+      uint16_t pinsA{}, pinsB{}, pinsC{};
+      ((Pins::port_id == 0 ? pinsA |= Pins::mask : Pins::port_id == 1 ? pinsB |= Pins::mask : pinsC |= Pins::mask), ...);
+      Check(((PortA::odr ^ odrA) & ~pinsA) == 0 && ((PortB::odr ^ odrB) & ~pinsB) == 0
+            && ((PortC::odr ^ odrC) & ~pinsC) == 0, "other pins changed");
+
+      uint32_t mask = rng() & valueMask;
+      uint32_t next = rng() & valueMask;
+      List::Write(next, mask);
+      Check(OdrPerPin<Pins...>() == ((value & ~mask) | (next & mask)), "masked write",
+            OdrPerPin<Pins...>(), (value & ~mask) | (next & mask));
+    }
+  }
+
+} //namespace
+
+int main()
+{
+  std::mt19937 rng{2024};
+  //The V2 digital outputs: Pa5..Pa7, Pb0..Pb2, Pb13..Pb15
+  TestList<2, MockPin<PortA, 5>, MockPin<PortA, 6>, MockPin<PortA, 7>, MockPin<PortB, 0>, MockPin<PortB, 1>,
+           MockPin<PortB, 2>, MockPin<PortB, 13>, MockPin<PortB, 14>, MockPin<PortB, 15>>(rng, "V2 outputs");
+  //Interleaved ports, reversed and inverted pins
+  TestList<3, MockPin<PortB, 3>, InvertedPin<MockPin<PortA, 0>>, MockPin<PortC, 15>, MockPin<PortA, 1>,
+           MockPin<PortB, 2>, InvertedPin<MockPin<PortC, 14>>, MockPin<PortA, 12>>(rng, "mixed list");
+  std::printf(failures ? "%zu failures\n" : "passed\n", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
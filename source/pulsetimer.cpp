@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pulsetimer.h"
+#include "digitalout.h"
+
+namespace Digital {
+
+  PulseTimer pulseTimer;
+
+  void PulseTimer::Init()
+  {
+    rccEnableTIM4(true);
+    rccResetTIM4();
+    tim_->PSC = STM32_TIMCLK1 / 1000000UL - 1;
+    tim_->ARR = tickPeriod - 1;
+    tim_->CCMR1 = 0;
+    tim_->EGR = TIM_EGR_UG;
+    tim_->SR = 0;
+    tim_->DIER = TIM_DIER_UIE;
+    nvicEnableVector(STM32_TIM4_NUMBER, irqPriority);
+    tim_->CR1 = TIM_CR1_CEN;
+  }
+
+  Rtos::Status PulseTimer::Start(const Pulse& pulse)
+  {
+    if(pulse.channel >= Output::numOutputs || !pulse.width || !pulse.count
+       || (pulse.count > 1 && pulse.period <= pulse.width)) {
+      return Rtos::Status::Failure;
+    }
+    Rtos::SysLockGuard lock;
+    Train* slot{};
+    for(auto& t : trains_) {
+      if(t.remaining && t.channel == pulse.channel) {
+        slot = &t;
+        break;
+      }
+      if(!t.remaining && !slot) {
+        slot = &t;
+      }
+    }
+    if(!slot) {
+      return Rtos::Status::Failure;
+    }
+    *slot = {NowI(), pulse.width, pulse.period, pulse.count, uint8_t(pulse.channel), false};
+    ScheduleI();
+    return Rtos::Status::Success;
+  }
+
+  uint32_t PulseTimer::GetActiveMask()
+  {
+    uint32_t mask{};
+    Rtos::SysLockGuard lock;
+    for(const auto& t : trains_) {
+      if(t.remaining) {
+        mask |= 1UL << t.channel;
+      }
+    }
+    return mask;
+  }
+
+  //The compare is armed only for the times inside the current timer period, the rest wait for the update
+  void PulseTimer::ArmCompareI(size_t cc, bool active, uint32_t time)
+  {
+    uint32_t ie = TIM_DIER_CC1IE << cc;
+    tim_->DIER &= ~ie;
+    tim_->SR = ~(TIM_SR_CC1IF << cc);
+    if(!active) {
+      return;
+    }
+    uint32_t offset = time - periodStart_;
+    if(int32_t(time - NowI()) <= 0) {
+      tim_->DIER |= ie;
+      tim_->EGR = TIM_EGR_CC1G << cc;
+    }
+    else if(offset < tickPeriod) {
+      (&tim_->CCR1)[cc] = offset;
+      tim_->DIER |= ie;
+      //The counter may have passed the compare value while it was written, the match would be a period late
+      if(int32_t(time - NowI()) <= 0) {
+        tim_->EGR = TIM_EGR_CC1G << cc;
+      }
+    }
+  }
+
+  void PulseTimer::ScheduleI()
+  {
+    const Train* first{};
+    for(const auto& t : trains_) {
+      if(t.remaining && (!first || int32_t(t.next - first->next) < 0)) {
+        first = &t;
+      }
+    }
+    ArmCompareI(0, first, first ? first->next : 0);
+  }
+
+  void PulseTimer::ProcessI()
+  {
+    uint32_t now = NowI();
+    for(auto& t : trains_) {
+      if(!t.remaining || int32_t(t.next - now) > 0) {
+        continue;
+      }
+      if(!t.on) {
+        output.PulseI(t.channel, true);
+        t.on = true;
+        t.next += t.width;
+      }
+      else {
+        output.PulseI(t.channel, false);
+        t.on = false;
+        if(--t.remaining) {
+          t.next += t.period - t.width;
+        }
+      }
+    }
+    ScheduleI();
+  }
+
+  void PulseTimer::ProcessAlarmI()
+  {
+    if(alarmArmed_ && int32_t(alarm_ - NowI()) <= 0) {
+      alarmArmed_ = false;
+      if(alarmCb_) {
+        alarmCb_();
+      }
+    }
+    ArmCompareI(1, alarmArmed_, alarm_);
+  }
+
+  void PulseTimer::ServeInterrupt()
+  {
+    uint32_t sr = tim_->SR & tim_->DIER;
+    tim_->SR = ~sr;
+    osalSysLockFromISR();
+    if(sr & TIM_SR_UIF) {
+      periodStart_ += tickPeriod;
+    }
+    ProcessI();
+    ProcessAlarmI();
+    osalSysUnlockFromISR();
+    if((sr & TIM_SR_UIF) && tickCb_) {
+      tickCb_();
+    }
+  }
+
+} //Digital
+
+OSAL_IRQ_HANDLER(STM32_TIM4_HANDLER)
+{
+  OSAL_IRQ_PROLOGUE();
+  Digital::pulseTimer.ServeInterrupt();
+  OSAL_IRQ_EPILOGUE();
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PULSETIMER_H
+#define PULSETIMER_H
+
+#include "ch_extended.h"
+#include "hal.h"
+#include <array>
+
+namespace Digital {
+
+  /*
+   * TIM4 driven directly with 1us ticks. The update event every 2ms is the input sampling tick,
+   * compare channel 1 times the edges of the output pulses, which are switched from the ISR,
+   * so the pulse width doesn't depend on the bus latency or the thread load.
+   * Compare channel 2 is a single alarm for the other timed users.
+   * The timebase is 32 bit and wraps every 71 minutes, only the differences are used.
+   */
+  class PulseTimer
+  {
+  public:
+    static constexpr uint32_t tickRate = 500;
+    static constexpr size_t maxTrains = 4;
+    using TickCallback = void(*)();
+    using AlarmCallback = void(*)();
+    struct Pulse {
+      uint16_t channel;
+      uint32_t width;   //us
+      uint32_t period;  //us, from the start of a pulse to the start of the next one
+      uint16_t count;   //pulses in the train
+    };
+  private:
+    static constexpr uint32_t tickPeriod = 1000000UL / tickRate;
+    static constexpr uint32_t irqPriority = 6;
+    struct Train {
+      uint32_t next;        //us, time of the next edge
+      uint32_t width, period;
+      uint16_t remaining;   //pulses not finished yet, 0 - the slot is free
+      uint8_t channel;
+      bool on;
+    };
+    TIM_TypeDef* const tim_;
+    TickCallback tickCb_;
+    AlarmCallback alarmCb_;
+    uint32_t periodStart_;  //us, time of the last update event
+    uint32_t alarm_;
+    bool alarmArmed_;
+    std::array<Train, maxTrains> trains_;
+    void ArmCompareI(size_t cc, bool active, uint32_t time);
+    void ScheduleI();
+    void ProcessI();
+    void ProcessAlarmI();
+  public:
+    PulseTimer() : tim_{TIM4}, tickCb_{}, alarmCb_{}, periodStart_{}, alarm_{}, alarmArmed_{}, trains_{}
+    { }
+    void Init();
+    //us, the timebase of the pulses and the alarm
+    uint32_t NowI() const
+    {
+      uint32_t cnt = tim_->CNT;
+      //The counter has wrapped and the update is not served yet
+      if((tim_->SR & TIM_SR_UIF) && cnt < tickPeriod / 2) {
+        cnt += tickPeriod;
+      }
+      return periodStart_ + cnt;
+    }
+    //Called from the ISR each tick without the system lock held
+    void SetTickCallback(TickCallback cb)
+    {
+      tickCb_ = cb;
+    }
+    //Called from the ISR with the system lock held, may arm the next alarm
+    void SetAlarmCallback(AlarmCallback cb)
+    {
+      alarmCb_ = cb;
+    }
+    //A time in the past fires at once
+    void ArmAlarmI(uint32_t time)
+    {
+      alarm_ = time;
+      alarmArmed_ = true;
+      ArmCompareI(1, true, time);
+    }
+    void CancelAlarmI()
+    {
+      alarmArmed_ = false;
+      ArmCompareI(1, false, 0);
+    }
+    //A new train on the channel replaces the running one, the channel is left cleared at the end
+    Rtos::Status Start(const Pulse& pulse);
+    //Bit per output channel with a train in progress
+    uint32_t GetActiveMask();
+    void ServeInterrupt();
+  };
+
+  extern PulseTimer pulseTimer;
+
+} //Digital
+
+#endif // PULSETIMER_H
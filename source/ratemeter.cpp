@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ratemeter.h"
+#include "counterbank.h"
+#include <algorithm>
+
+namespace Digital {
+
+  void RateMeter::Init()
+  {
+    static_assert(nvram::Eeprom::Fits(nvram::Section::RateWindows, 0, sizeof(windows_t)),
+                  "Rate windows don't fit the configured EEPROM");
+    windows_t windows;
+    if(sizeof(windows) == nvram::eeprom.Read(nvram::Section::RateWindows, windows) && IsValid(windows)) {
+      windows_ = windows;
+    }
+    start(NORMALPRIO + 10);
+  }
+
+  Rtos::Status RateMeter::SetWindows(const windows_t& windows)
+  {
+    if(!IsValid(windows)) {
+      return Rtos::Status::Failure;
+    }
+    {
+      Rtos::SemLockGuard lock{sem_};
+      windows_ = windows;
+    }
+    if(sizeof(windows) != nvram::eeprom.Write(nvram::Section::RateWindows, windows)) {
+      return Rtos::Status::Failure;
+    }
+    return Rtos::Status::Success;
+  }
+
+  RateMeter::rates_t RateMeter::GetRates()
+  {
+    rates_t rates{};
+    Rtos::SemLockGuard lock{sem_};
+    if(filled_ < 2) {
+      return rates;
+    }
+    const auto& latest = ring_[head_];
+    for(size_t ch{}; ch < numChannels; ++ch) {
+      size_t window = std::min<size_t>(windows_[ch], filled_ - 1);
+      const auto& oldest = ring_[(head_ + depth - window) % depth];
+      uint32_t pulses = latest[ch] - oldest[ch];
+      rates[ch] = uint32_t(uint64_t(pulses) * 1000000 / (window * periodMs));
+    }
+    return rates;
+  }
+
+  void RateMeter::main()
+  {
+    setName("RateMeter");
+    systime_t time = chVTGetSystemTimeX();
+    while(true) {
+      time += MS2ST(periodMs);
+      sleepUntil(time);
+      //Also keeps the 64-bit counters extended
+      auto counters = counterBank.Update();
+      Rtos::SemLockGuard lock{sem_};
+      head_ = (head_ + 1) % depth;
+      std::copy(counters.begin(), counters.end(), ring_[head_].begin());
+      if(filled_ < depth) {
+        ++filled_;
+      }
+    }
+  }
+
+  RateMeter rateMeter;
+
+} //Digital
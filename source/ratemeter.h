@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RATEMETER_H
+#define RATEMETER_H
+
+#include "digitalin.h"
+#include <array>
+
+namespace Digital {
+
+  /*
+   * Pulse rates of the input counters, computed from the ring of counter snapshots
+   * taken every periodMs. The raw counters are used, so a remote reset doesn't disturb the rates.
+   * The window is set per channel in periods and stored in EEPROM.
+   */
+  class RateMeter : Rtos::BaseStaticThread<256>
+  {
+  public:
+    static constexpr size_t numChannels = Input::numChannels;
+    static constexpr uint32_t periodMs = 250;
+    static constexpr uint16_t maxWindow = 31;
+    static constexpr uint16_t defaultWindow = 1000 / periodMs;
+    using windows_t = std::array<uint16_t, numChannels>;
+    using rates_t = std::array<uint32_t, numChannels>;  //mHz
+  private:
+    using snapshot_t = std::array<uint32_t, numChannels>;
+    static constexpr size_t depth = maxWindow + 1;
+    static_assert(sizeof(windows_t) <= nvram::Eeprom::SectionSize, "Rate windows section overflow");
+    std::array<snapshot_t, depth> ring_;
+    //Index of the latest snapshot and the number of valid ones
+    size_t head_, filled_;
+    windows_t windows_;
+    Rtos::BinarySemaphore sem_;
+    static bool IsValid(const windows_t& windows)
+    {
+      for(auto w : windows) {
+        if(!w || w > maxWindow) {
+          return false;
+        }
+      }
+      return true;
+    }
+  public:
+    RateMeter() : ring_{}, head_{}, filled_{}, sem_{false}
+    {
+      windows_.fill(defaultWindow);
+    }
+    void Init();
+    Rtos::Status SetWindows(const windows_t& windows);
+    windows_t GetWindows()
+    {
+      Rtos::SemLockGuard lock{sem_};
+      return windows_;
+    }
+    //Until the ring is filled the windows are limited to the time passed since the start
+    rates_t GetRates();
+    void main() override;
+  };
+
+  extern RateMeter rateMeter;
+
+} //Digital
+
+#endif // RATEMETER_H
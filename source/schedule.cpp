@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "schedule.h"
+#include "pulsetimer.h"
+
+namespace Digital {
+
+  Schedule schedule;
+
+  void Schedule::Init()
+  {
+    pulseTimer.SetAlarmCallback(AlarmI);
+  }
+
+  Rtos::Status Schedule::SetEntry(size_t index, const Entry& entry)
+  {
+    using Mode = OutputCommand::Mode;
+    if(index >= maxEntries || running_) {
+      return Rtos::Status::Failure;
+    }
+    switch(entry.mode) {
+    case Mode::Set:
+    case Mode::Clear:
+    case Mode::Write:
+    case Mode::Toggle:
+      break;
+    default:
+      return Rtos::Status::Failure;
+    }
+    if(entry.value > Utils::NumberToMask_v<OutputCommand::GetBusWidth()> || entry.offset > maxOffset) {
+      return Rtos::Status::Failure;
+    }
+    entries_[index] = entry;
+    return Rtos::Status::Success;
+  }
+
+  Rtos::Status Schedule::SetLength(size_t length)
+  {
+    if(length > maxEntries || running_) {
+      return Rtos::Status::Failure;
+    }
+    length_ = uint16_t(length);
+    return Rtos::Status::Success;
+  }
+
+  Rtos::Status Schedule::Start()
+  {
+    Rtos::SysLockGuard lock;
+    if(!length_) {
+      return Rtos::Status::Failure;
+    }
+    for(size_t i = 1; i < length_; ++i) {
+      if(entries_[i].offset < entries_[i - 1].offset) {
+        return Rtos::Status::Failure;
+      }
+    }
+    start_ = pulseTimer.NowI();
+    position_ = 0;
+    running_ = true;
+    pulseTimer.ArmAlarmI(start_ + entries_[0].offset);
+    return Rtos::Status::Success;
+  }
+
+  void Schedule::Stop()
+  {
+    Rtos::SysLockGuard lock;
+    if(running_) {
+      running_ = false;
+      pulseTimer.CancelAlarmI();
+    }
+  }
+
+  void Schedule::AlarmI()
+  {
+    schedule.ProcessI();
+  }
+
+  //All the entries due by now are executed at once, the same offsets switch together
+  void Schedule::ProcessI()
+  {
+    if(!running_) {
+      return;
+    }
+    uint32_t now = pulseTimer.NowI();
+    while(position_ < length_ && int32_t(start_ + entries_[position_].offset - now) <= 0) {
+      const Entry& entry = entries_[position_++];
+      OutputCommand cmd{};
+      cmd.Set(entry.mode, entry.value);
+      output.ExecuteI(cmd);
+    }
+    if(position_ < length_) {
+      pulseTimer.ArmAlarmI(start_ + entries_[position_].offset);
+    }
+    else {
+      running_ = false;
+    }
+  }
+
+} //Digital
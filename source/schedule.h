@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include "ch_extended.h"
+#include "digitalout.h"
+#include <array>
+
+namespace Digital {
+
+  /*
+   * Output command table played from the pulse timer alarm. The offsets are counted from the start,
+   * not from the previous entry, so the timing doesn't drift over a long table.
+   * Only the commands for the first output word are stored.
+   */
+  class Schedule
+  {
+  public:
+    static constexpr size_t maxEntries = 32;
+    //Half of the timebase range, the alarm compares the signed difference
+    static constexpr uint32_t maxOffset = 0x7FFFFFFFUL;
+    struct Entry {
+      uint32_t offset;  //us from the start, non-decreasing over the table
+      uint16_t value;
+      OutputCommand::Mode mode;
+    };
+  private:
+    std::array<Entry, maxEntries> entries_;
+    uint32_t start_;
+    uint16_t length_;
+    uint16_t position_;
+    bool running_;
+    static void AlarmI();
+    void ProcessI();
+  public:
+    Schedule() : entries_{}, start_{}, length_{}, position_{}, running_{}
+    { }
+    void Init();
+    //The table can't be changed while it is played
+    Rtos::Status SetEntry(size_t index, const Entry& entry);
+    Entry GetEntry(size_t index) const
+    {
+      return entries_[index];
+    }
+    Rtos::Status SetLength(size_t length);
+    size_t GetLength() const
+    {
+      return length_;
+    }
+    //Index of the next entry to be executed
+    size_t GetPosition() const
+    {
+      return position_;
+    }
+    bool IsRunning() const
+    {
+      return running_;
+    }
+    //Restarts from the first entry if it is already running
+    Rtos::Status Start();
+    void Stop();
+  };
+
+  extern Schedule schedule;
+
+} //Digital
+
+#endif // SCHEDULE_H
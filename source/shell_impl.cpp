@@ -26,12 +26,20 @@
 #include "digitalout.h"
 #include "analogin.h"
 #include "digitalin.h"
+#include "counterbank.h"
+#include "counterstore.h"
 #include "modbus_impl.h"
+#include "pulsetimer.h"
+#include "schedule.h"
+#include "logic.h"
 #include "chprintf.h"
 #include "string_utils.h"
+#include "cyclecounter.h"
 
 #if BOARD_VER == 1
 #include "analogout.h"
+#else
+#include "softpwm.h"
 #endif
 
 using namespace std::literals;
@@ -43,9 +51,16 @@ static void cmd_setanalog(BaseSequentialStream *chp, int argc, char *argv[]);
 static void cmd_getanalog(BaseSequentialStream *chp, int argc, char *argv[]);
 static void cmd_setdigital(BaseSequentialStream *chp, int argc, char *argv[]);
 static void cmd_getdigital(BaseSequentialStream *chp, int argc, char *argv[]);
+static void cmd_pulse(BaseSequentialStream *chp, int argc, char *argv[]);
+static void cmd_schedule(BaseSequentialStream *chp, int argc, char *argv[]);
+#if BOARD_VER == 2
+static void cmd_softpwm(BaseSequentialStream *chp, int argc, char *argv[]);
+#endif
 static void cmd_getcounters(BaseSequentialStream *chp, int argc, char *argv[]);
 static void cmd_uptime(BaseSequentialStream *chp, int argc, char *argv[]);
+static void cmd_journal(BaseSequentialStream *chp, int argc, char *argv[]);
 static void cmd_setmbid(BaseSequentialStream *chp, int argc, char *argv[]);
+static void cmd_bench(BaseSequentialStream *chp, int argc, char *argv[]);
 
 static const ShellCommand commands[] = {
 #if BOARD_VER == 1
@@ -54,9 +69,16 @@ static const ShellCommand commands[] = {
   {"getanalog", cmd_getanalog},
   {"setdigital", cmd_setdigital},
   {"getdigital", cmd_getdigital},
+  {"pulse", cmd_pulse},
+  {"schedule", cmd_schedule},
+#if BOARD_VER == 2
+  {"softpwm", cmd_softpwm},
+#endif
   {"getcounters", cmd_getcounters},
   {"uptime", cmd_uptime},
+  {"journal", cmd_journal},
   {"setmbid", cmd_setmbid},
+  {"bench", cmd_bench},
   {nullptr, nullptr}
 };
 
@@ -180,10 +202,10 @@ void cmd_getcounters(BaseSequentialStream *chp, int argc, char *argv[])
     else {
       break;
     }
-    auto counters = input.GetCounters();
+    auto counters = counterBank.Get();
     for(size_t i{}; i < counters.size(); ++i) {
       if(channelMask & (1U << i)) {
-        chprintf(chp, "%10u ", counters[i]);
+        chprintf(chp, "%10u ", uint32_t(counters[i]));
       }
     }
     chprintf(chp, "\r\n");
@@ -264,6 +286,108 @@ void cmd_setdigital(BaseSequentialStream *chp, int argc, char *argv[])
                   "\r\n\tsetdigital toggle 666");
 }
 
+void cmd_pulse(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  using namespace Digital;
+  do {
+    if(!argc) {
+      chprintf(chp, "%x\r\n", pulseTimer.GetActiveMask());
+      return;
+    }
+    if(argc != 2 && argc != 4) {
+      break;
+    }
+    std::array<uint32_t, 4> params{0, 0, 1, 0};
+    bool valid = true;
+    for(int i{}; i < argc; ++i) {
+      auto val = io::svtou(argv[i]);
+      valid = valid && val;
+      params[size_t(i)] = val ? *val : 0;
+    }
+    if(!valid || params[0] > 0xFFFF || params[2] > 0xFFFF) {
+      break;
+    }
+    PulseTimer::Pulse pulse{uint16_t(params[0]), params[1], params[3], uint16_t(params[2])};
+    if(pulseTimer.Start(pulse) != Rtos::Status::Success) {
+      break;
+    }
+    return;
+  } while(false);
+  shellUsage(chp, "Timed pulses on a digital output, without arguments returns the mask of the running trains"
+                  "\r\n\tpulse [channel] [width, us] [count] [period, us]"
+                  "\r\nExamples:"
+                  "\r\n\tpulse 3 1500"
+                  "\r\n\tpulse 0 100 10 1000");
+}
+
+void cmd_schedule(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  using namespace Digital;
+  do {
+    if(!argc) {
+      chprintf(chp, "%s %u/%u\r\n", schedule.IsRunning() ? "running" : "stopped",
+               schedule.GetPosition(), schedule.GetLength());
+      return;
+    }
+    if(argc != 1) {
+      break;
+    }
+    if("start"sv == argv[0]) {
+      if(schedule.Start() != Rtos::Status::Success) {
+        break;
+      }
+      return;
+    }
+    if("stop"sv == argv[0]) {
+      schedule.Stop();
+      return;
+    }
+  } while(false);
+  shellUsage(chp, "Output schedule loaded over MODBUS, without arguments returns the state and the position"
+                  "\r\n\tschedule [start|stop]");
+}
+
+#if BOARD_VER == 2
+void cmd_softpwm(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  using namespace Digital;
+  do {
+    if(!argc) {
+      chprintf(chp, "%x\r\n", softPwm.GetMask());
+      for(size_t ch{}; ch < SoftPwm::numChannels; ++ch) {
+        chprintf(chp, "%u ", softPwm.GetDuty(ch));
+      }
+      chprintf(chp, "\r\n");
+      return;
+    }
+    if(argc != 2) {
+      break;
+    }
+    auto ch = io::svtou(argv[0]);
+    if(!ch || *ch >= SoftPwm::numChannels) {
+      break;
+    }
+    uint32_t bit = 1UL << *ch;
+    if("off"sv == argv[1]) {
+      softPwm.SetMask(softPwm.GetMask() & ~bit);
+      return;
+    }
+    auto duty = io::svtou(argv[1]);
+    if(!duty || *duty > SoftPwm::resolution) {
+      break;
+    }
+    softPwm.SetDuty(*ch, uint16_t(*duty));
+    softPwm.SetMask(softPwm.GetMask() | bit);
+    return;
+  } while(false);
+  shellUsage(chp, "Software PWM on a digital output, without arguments returns the mask and the duties"
+                  "\r\n\tsoftpwm [channel] [duty(0-100)|off]"
+                  "\r\nExamples:"
+                  "\r\n\tsoftpwm 2 25"
+                  "\r\n\tsoftpwm 2 off");
+}
+#endif
+
 void cmd_uptime(BaseSequentialStream *chp, int argc, char **/*argv[]*/)
 {
   if(!argc) {
@@ -271,6 +395,19 @@ void cmd_uptime(BaseSequentialStream *chp, int argc, char **/*argv[]*/)
   }
 }
 
+void cmd_journal(BaseSequentialStream *chp, int argc, char **/*argv[]*/)
+{
+  if(!argc) {
+    auto stat = Digital::counterStore.GetStat();
+    chprintf(chp, "seq %u, last write %u us, last emergency write %u us, power fails %u\r\n",
+             stat.seq, stat.lastWriteUs, stat.urgentWriteUs, stat.powerFails);
+  }
+  else {
+    shellUsage(chp, "Counters journal state: record sequence number, duration of the last record write"
+                    "\r\nand of the last power fail checkpoint, the number of the power fail checkpoints");
+  }
+}
+
 void cmd_setmbid(BaseSequentialStream *chp, int argc, char* argv[])
 {
   do {
@@ -299,6 +436,164 @@ void cmd_setmbid(BaseSequentialStream *chp, int argc, char* argv[])
                   "\r\n\tsetmbid [1-246]");
 }
 
+void cmd_bench(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  using Utils::CycleCounter;
+  static constexpr size_t iterations = 1000;
+  do {
+    if(argc != 1) {
+      break;
+    }
+    if("cal"sv == argv[0]) {
+      using namespace Analog;
+      Input::sample_buf_t buf;
+      Input::eng_buf_t eng;
+      for(size_t i{}; i < buf.size(); ++i) {
+        buf[i] = adcsample_t(i * 4095 / (buf.size() - 1));
+      }
+      auto& cal = input.GetCalibration();
+      auto raw = CycleCounter::Measure([&] { std::copy(buf.begin(), buf.end(), eng.begin()); }, iterations);
+      auto calibrated = CycleCounter::Measure([&] { cal.Apply(buf, eng); }, iterations);
+      chprintf(chp, "raw copy: %u, calibrated: %u cycles per sample set (%d)\r\n", raw, calibrated, eng.back());
+      return;
+    }
+    if("thd"sv == argv[0]) {
+      using namespace Analog;
+      //Every channel toggles each sample set, the worst case for the counters update
+      std::array<Input::sample_buf_t, 2> bufs;
+      bufs[0].fill(0);
+      bufs[1].fill(Thresholds<Input::numChannels>::maxValue);
+      auto& thresholds = input.GetThresholds();
+      auto config = thresholds.Get();
+      Input::counters_buf_t counters{};
+      uint16_t binaryVal{};
+      size_t n{};
+      auto scalar = CycleCounter::Measure([&] {
+        const auto& buf = bufs[n++ & 0x01];
+        uint16_t binarySet{}, binaryClear{};
+        for(size_t i{}; i < Input::numChannels; ++i) {
+          if(buf[i] > config[i].threshold) {
+            binarySet |= (1U << i);
+          }
+          if(buf[i] < config[i].threshold - config[i].hysteresis) {
+            binaryClear |= (1U << i);
+          }
+        }
+        uint16_t positiveTransitionMask = binarySet & ~binaryVal;
+        for(size_t i{}; i < Input::numChannels; ++i) {
+          counters[i] += (positiveTransitionMask >> i) & 0x01;
+        }
+        binaryVal = (binaryVal | binarySet) & ~binaryClear;
+      }, iterations);
+      auto swar = CycleCounter::Measure([&] {
+        const auto& buf = bufs[n++ & 0x01];
+        uint16_t binarySet, binaryClear;
+        thresholds.Process(buf, binarySet, binaryClear);
+        uint16_t positiveTransitionMask = binarySet & ~binaryVal;
+        Utils::ForEachSetBit(positiveTransitionMask, [&](uint32_t i) { ++counters[i]; });
+        binaryVal = (binaryVal | binarySet) & ~binaryClear;
+      }, iterations);
+      chprintf(chp, "scalar: %u, swar: %u cycles per sample set (%u)\r\n", scalar, swar, counters[0]);
+      return;
+    }
+    if("pins"sv == argv[0]) {
+      //Same pins as V2 digital outputs, the writes put back the output register, so no pin changes
+      using namespace Mcudrv;
+      using Pins = Pinlist<Pa5, Pa6, Pa7, Pb0, Pb1, Pb2, Pb13, Pb14, Pb15>;
+      uint32_t val{};
+      auto perPin = CycleCounter::Measure([&] {
+        val ^= uint32_t(Pa5::IsSet()) | uint32_t(Pa6::IsSet()) << 1 | uint32_t(Pa7::IsSet()) << 2
+               | uint32_t(Pb0::IsSet()) << 3 | uint32_t(Pb1::IsSet()) << 4 | uint32_t(Pb2::IsSet()) << 5
+               | uint32_t(Pb13::IsSet()) << 6 | uint32_t(Pb14::IsSet()) << 7 | uint32_t(Pb15::IsSet()) << 8;
+      }, iterations);
+      auto grouped = CycleCounter::Measure([&] { val ^= Pins::Read(); }, iterations);
+      chprintf(chp, "per pin: %u, port grouped: %u cycles per read (%x)\r\n", perPin, grouped, val);
+      const uint32_t odr = Pins::ReadODR();
+      perPin = CycleCounter::Measure([&] {
+        Pa5::SetOrClear(odr & 0x001); Pa6::SetOrClear(odr & 0x002); Pa7::SetOrClear(odr & 0x004);
+        Pb0::SetOrClear(odr & 0x008); Pb1::SetOrClear(odr & 0x010); Pb2::SetOrClear(odr & 0x020);
+        Pb13::SetOrClear(odr & 0x040); Pb14::SetOrClear(odr & 0x080); Pb15::SetOrClear(odr & 0x100);
+      }, iterations);
+      grouped = CycleCounter::Measure([&] { Pins::Write(odr); }, iterations);
+      chprintf(chp, "per pin: %u, port grouped: %u cycles per write\r\n", perPin, grouped);
+      return;
+    }
+    if("logic"sv == argv[0]) {
+      //The longest instructions fill the whole program, every input toggles each scan
+      using namespace Digital;
+      using Op = LogicEngine::Op;
+      LogicEngine::program_t program;
+      size_t pc{};
+      for(uint8_t i{}; pc + 7 < LogicEngine::maxWords; ++i) {
+        program[pc++] = LogicEngine::Instruction(Op::CntGe, i % CounterBank::numChannels);
+        program[pc++] = 0;
+        program[pc++] = 1;
+        program[pc++] = LogicEngine::Instruction(Op::Ton, i % LogicEngine::numTimers);
+        program[pc++] = 0;
+        program[pc++] = LogicEngine::Instruction(Op::RTrig, i % LogicEngine::numEdges);
+        program[pc++] = LogicEngine::Instruction(Op::Out, i % OutputCommand::GetBusWidth());
+      }
+      while(pc < LogicEngine::maxWords) {
+        program[pc++] = LogicEngine::Instruction(Op::End);
+      }
+      LogicEngine::Inputs inputs{};
+      LogicEngine::State state{};
+      uint32_t outputs{};
+      auto cycles = CycleCounter::Measure([&] {
+        inputs.counters.fill(inputs.now & 0x01);
+        ++inputs.now;
+        outputs ^= LogicEngine::Evaluate(program, inputs, state).set;
+      }, iterations);
+      chprintf(chp, "worst case program: %u cycles, %u us per scan, verified: %d (%x)\r\n",
+               cycles, cycles / (STM32_SYSCLK / 1000000UL), LogicEngine::Verify(program), outputs);
+      chprintf(chp, "running program worst scan: %u cycles\r\n", logicEngine.GetMaxScanCycles());
+      return;
+    }
+#if BOARD_VER == 1
+    if("dout"sv == argv[0]) {
+      using namespace Digital;
+      OutputCommand cmd{};
+      cmd.SetMode(OutputCommand::Mode::Refresh);
+      output.SendMessage(cmd);
+      //The message is released as soon as the transfer is started
+      Rtos::Sleep(MS2ST(1));
+      uint32_t cycles = output.GetUpdateCycles();
+      chprintf(chp, "%u outputs: %u cycles, %u us from the transfer start to the latch, SPI bound %u ns\r\n",
+               Output::numOutputs, cycles, cycles / (STM32_SYSCLK / 1000000UL), Output::shiftTimeNs);
+      return;
+    }
+    if("dither"sv == argv[0]) {
+      //All channels carry a fraction, the step of every period in the update interrupt
+      using namespace Analog;
+      std::array<uint32_t, OutputCommand::GetChannelNumber()> values{0x12345, 0x801, 0xFFF7F, 0x40};
+      std::array<uint32_t, OutputCommand::GetChannelNumber()> acc{};
+      uint32_t sum{};
+      auto cycles = CycleCounter::Measure([&] {
+        for(size_t ch{}; ch < values.size(); ++ch) {
+          sum += Output::Dither(values[ch], acc[ch]);
+        }
+      }, iterations);
+      chprintf(chp, "%u channels: %u cycles per period (%u)\r\n", values.size(), cycles, sum);
+      chprintf(chp, "update interrupt worst case: %u cycles\r\n", output.GetMaxPeriodCycles());
+      output.ResetMaxPeriodCycles();
+      return;
+    }
+#endif
+  } while(false);
+  shellUsage(chp, "Measure average core cycles per call of the processing kernels"
+                  "\r\n\tbench [kernel]"
+                  "\r\nKernels:"
+                  "\r\n\tcal - analog calibration of the whole sample set"
+                  "\r\n\tthd - analog thresholds and edge counting, scalar vs packed"
+                  "\r\n\tpins - 9 pins on 2 ports read and written, per pin vs port grouped"
+                  "\r\n\tlogic - logic engine scan of the longest program, and of the running one"
+#if BOARD_VER == 1
+                  "\r\n\tdout - single update of the output shift register chain"
+                  "\r\n\tdither - sigma-delta step of the analog outputs, and the update interrupt"
+#endif
+                  );
+}
+
 Shell::Shell()
 {
   palSetPadMode(GPIOB, 6, PAL_MODE_STM32_ALTERNATE_PUSHPULL); // tx
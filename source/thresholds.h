@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef THRESHOLDS_H
+#define THRESHOLDS_H
+
+#include "hal.h"
+#include "ch_extended.h"
+#include "at24_impl.h"
+
+#include <array>
+#include <cstring>
+
+namespace Analog {
+
+  struct ThresholdConfig {
+    uint16_t threshold;   //binary value is set above the threshold
+    uint16_t hysteresis;  //and cleared below (threshold - hysteresis)
+  };
+
+  /*
+   * SIMD within a register comparator, two 12-bit samples are packed in a 32-bit word.
+   * Bit 15 of each 16-bit lane is a guard bit, after the subtraction it holds "greater or equal" result.
+   */
+  template<size_t numChannels>
+  class Thresholds
+  {
+  public:
+    using config_t = std::array<ThresholdConfig, numChannels>;
+    static constexpr ThresholdConfig defaultConfig{4096 / 2, 4096 / 4};
+    static constexpr uint16_t maxValue = 4095;
+  private:
+    static_assert(sizeof(adcsample_t) == sizeof(uint16_t), "Lane size mismatch");
+    static_assert(sizeof(config_t) <= nvram::Eeprom::SectionSize * 2, "Thresholds section overflow");
+    static constexpr size_t numWords = (numChannels + 1) / 2;
+    static constexpr uint32_t guard = 0x80008000UL;
+    //Never reached by 12-bit samples, used in the padding lane
+    static constexpr uint16_t unreachable = 0x7FFF;
+    using packed_t = std::array<uint32_t, numWords>;
+    packed_t setLevel_, clearLevel_;
+    config_t config_;
+
+    static bool IsValid(const ThresholdConfig& cfg)
+    {
+      return cfg.threshold <= maxValue && cfg.hysteresis <= cfg.threshold;
+    }
+    //Set level is threshold + 1, so the both comparisons are "greater or equal" ones
+    static void Pack(const config_t& config, packed_t& setLevel, packed_t& clearLevel)
+    {
+      std::array<uint16_t, numWords * 2> set, clear;
+      set.fill(unreachable);
+      clear.fill(0);
+      for(size_t i{}; i < numChannels; ++i) {
+        set[i] = uint16_t(config[i].threshold + 1);
+        clear[i] = uint16_t(config[i].threshold - config[i].hysteresis);
+      }
+      std::memcpy(setLevel.data(), set.data(), sizeof(setLevel));
+      std::memcpy(clearLevel.data(), clear.data(), sizeof(clearLevel));
+    }
+    void Apply(const config_t& config)
+    {
+      packed_t setLevel, clearLevel;
+      Pack(config, setLevel, clearLevel);
+      //The reader is lock-free, a torn update affects a single sample set at most
+      Rtos::SysLockGuard lock;
+      setLevel_ = setLevel;
+      clearLevel_ = clearLevel;
+      config_ = config;
+    }
+    static uint32_t GatherLanes(uint32_t packed)
+    {
+      return ((packed >> 15) | (packed >> 30)) & 0x03;
+    }
+  public:
+    Thresholds()
+    {
+      config_.fill(defaultConfig);
+      Pack(config_, setLevel_, clearLevel_);
+    }
+    void Load()
+    {
+      static_assert(nvram::Eeprom::Fits(nvram::Section::AnalogThresholds, 0, sizeof(config_t)),
+                    "Thresholds don't fit the configured EEPROM");
+      config_t config;
+      if(sizeof(config) != nvram::eeprom.Read(nvram::Section::AnalogThresholds, config)) {
+        return;
+      }
+      for(const auto& cfg : config) {
+        if(!IsValid(cfg)) {
+          return;
+        }
+      }
+      Apply(config);
+    }
+    Rtos::Status Set(const config_t& config)
+    {
+      for(const auto& cfg : config) {
+        if(!IsValid(cfg)) {
+          return Rtos::Status::Failure;
+        }
+      }
+      Apply(config);
+      if(sizeof(config) != nvram::eeprom.Write(nvram::Section::AnalogThresholds, config)) {
+        return Rtos::Status::Failure;
+      }
+      return Rtos::Status::Success;
+    }
+    config_t Get()
+    {
+      Rtos::SysLockGuard lock;
+      return config_;
+    }
+    template<typename SampleBuf>
+    void Process(const SampleBuf& buf, uint16_t& setMask, uint16_t& clearMask) const
+    {
+      packed_t samples{};
+      std::memcpy(samples.data(), buf.data(), sizeof(adcsample_t) * numChannels);
+      uint32_t set{}, clear{};
+      for(size_t i{}; i < numWords; ++i) {
+        uint32_t biased = samples[i] | guard;
+        set |= GatherLanes((biased - setLevel_[i]) & guard) << (i * 2);
+        clear |= GatherLanes(~(biased - clearLevel_[i]) & guard) << (i * 2);
+      }
+      setMask = uint16_t(set);
+      clearMask = uint16_t(clear);
+    }
+  };
+
+} //Analog
+
+#endif // THRESHOLDS_H
@@ -81,6 +81,10 @@ namespace Rtos {
     {  }
     msg_t Suspend(systime_t timeout = 0) {
       SysLockGuard lock;
+      return SuspendS(timeout);
+    }
+    //To be called in a locked state
+    msg_t SuspendS(systime_t timeout = 0) {
       return timeout ? chThdSuspendTimeoutS(&ref_, timeout) : chThdSuspendS(&ref_);
     }
     void Resume(msg_t msg = MSG_OK)
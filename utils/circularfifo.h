@@ -38,6 +38,7 @@ namespace memory_relaxed_acquire_release {
 
     bool wasEmpty() const;
     bool wasFull() const;
+    size_t wasSize() const;
     bool isLockFree() const;
 
   private:
@@ -93,6 +94,15 @@ namespace memory_relaxed_acquire_release {
   }
 
 
+  // snapshot with acceptance that the indexes are not read atomically
+  template<typename Element, size_t Size>
+  size_t CircularFifo<Element, Size>::wasSize() const
+  {
+    const auto tail = _tail.load();
+    const auto head = _head.load();
+    return tail >= head ? tail - head : Capacity - head + tail;
+  }
+
   template<typename Element, size_t Size>
   bool CircularFifo<Element, Size>::isLockFree() const
   {
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2018 Dmytro Shestakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef CYCLECOUNTER_H
+#define CYCLECOUNTER_H
+
+#include "stm32f1xx.h"
+#include <stddef.h>
+
+namespace Utils {
+
+  //DWT based profiling helper, the values are core clock cycles
+  struct CycleCounter
+  {
+    static void Enable()
+    {
+      CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+      DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+    static uint32_t Get()
+    {
+      return DWT->CYCCNT;
+    }
+    //Average cycles per call
+    template<typename F>
+    static uint32_t Measure(F&& func, size_t iterations = 1)
+    {
+      Enable();
+      uint32_t start = Get();
+      for(size_t i{}; i < iterations; ++i) {
+        func();
+      }
+      return (Get() - start) / iterations;
+    }
+  };
+
+} //Utils
+
+#endif // CYCLECOUNTER_H
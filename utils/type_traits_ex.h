@@ -23,6 +23,8 @@
 #define TYPE_TRAITS_EX_H
 
 #include <type_traits>
+#include <utility>
+#include <array>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -136,6 +138,142 @@ namespace Utils {
   {
     return val && !(val & (val - 1));
   }
+
+//Bit permutation helpers
+
+  struct ShiftGroup {
+    int shift;
+    uint32_t mask;    //source bits
+  };
+
+  template<size_t N>
+  struct ShiftGroups {
+    std::array<ShiftGroup, N> groups;
+    size_t count;
+  };
+
+//dest[i] is the destination position of the source bit i, negative value drops the bit.
+//The source bits moved by the same distance form a group.
+  template<size_t N>
+  static constexpr ShiftGroups<N> MakeShiftGroups(const std::array<int8_t, N>& dest)
+  {
+    ShiftGroups<N> result{};
+    for(size_t i{}; i < N; ++i) {
+      if(dest[i] < 0) {
+        continue;
+      }
+      int shift = dest[i] - int(i);
+      size_t g{};
+      while(g < result.count && result.groups[g].shift != shift) {
+        ++g;
+      }
+      if(g == result.count) {
+        result.groups[g].shift = shift;
+        ++result.count;
+      }
+      result.groups[g].mask |= 1UL << i;
+    }
+    return result;
+  }
+
+  template<int shift>
+  static constexpr uint32_t ShiftBy(uint32_t val)
+  {
+    if constexpr(shift >= 0) {
+      return val << shift;
+    }
+    else {
+      return val >> -shift;
+    }
+  }
+
+  template<int8_t... dest>
+  struct DestList {
+    static constexpr std::array<int8_t, sizeof...(dest)> Get()
+    {
+      return {dest...};
+    }
+  };
+
+//Map::Get() returns the destination positions, see MakeShiftGroups().
+//Every group costs a mask, a shift and an or. When there are too many distinct distances
+//a lookup table per source nibble is used instead.
+  template<typename Map>
+  class Permutation
+  {
+    static constexpr auto dest = Map::Get();
+    static constexpr size_t size = dest.size();
+    static constexpr auto shiftGroups = MakeShiftGroups(dest);
+    static constexpr size_t numNibbles = (size + 3) / 4;
+    //Rough estimate, a table lookup takes the shift, mask, load with flash wait states and or
+    static constexpr bool useLut = shiftGroups.count * 3 > numNibbles * 5;
+    static constexpr int MaxDest()
+    {
+      int result{};
+      for(auto d : dest) {
+        result = d > result ? d : result;
+      }
+      return result;
+    }
+    using lut_value_t = SelectSize_t<MaxDest() + 1>;
+    using lut_t = std::array<std::array<lut_value_t, 16>, numNibbles>;
+    static constexpr lut_t MakeLut()
+    {
+      lut_t lut{};
+      for(size_t n{}; n < numNibbles; ++n) {
+        for(uint32_t val{}; val < 16; ++val) {
+          uint32_t result{};
+          for(size_t bit{}; bit < 4 && n * 4 + bit < size; ++bit) {
+            if((val & (1U << bit)) && dest[n * 4 + bit] >= 0) {
+              result |= 1UL << dest[n * 4 + bit];
+            }
+          }
+          lut[n][val] = lut_value_t(result);
+        }
+      }
+      return lut;
+    }
+    static constexpr lut_t lut = useLut ? MakeLut() : lut_t{};
+    template<size_t... g>
+    static constexpr uint32_t ApplyGroups(uint32_t val, std::index_sequence<g...>)
+    {
+      return (0UL | ... | ShiftBy<shiftGroups.groups[g].shift>(val & shiftGroups.groups[g].mask));
+    }
+    template<size_t... n>
+    static constexpr uint32_t ApplyLut(uint32_t val, std::index_sequence<n...>)
+    {
+      return (0UL | ... | lut[n][(val >> (n * 4)) & 0x0F]);
+    }
+  public:
+    static constexpr int Destination(size_t i)
+    {
+      return dest[i];
+    }
+    static constexpr uint32_t Apply(uint32_t val)
+    {
+      if constexpr(useLut) {
+        return ApplyLut(val, std::make_index_sequence<numNibbles>{});
+      }
+      else {
+        return ApplyGroups(val, std::make_index_sequence<shiftGroups.count>{});
+      }
+    }
+  };
+
+//BitPermutation<2, 0, 1>::Apply(0b011) == 0b101
+  template<int8_t... dest>
+  using BitPermutation = Permutation<DestList<dest...>>;
+
+//Calls func(position) for each set bit, from the most significant one, the cost depends on set bits only
+  template<typename F>
+  static inline void ForEachSetBit(uint32_t mask, F&& func)
+  {
+    while(mask) {
+      uint32_t pos = 31 - uint32_t(__builtin_clz(mask));
+      func(pos);
+      mask ^= 1UL << pos;
+    }
+  }
 }
 
 #endif //TYPE_TRAITS_H